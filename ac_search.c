@@ -0,0 +1,330 @@
+#include <stdbool.h>
+#include <stddef.h>
+#multipattern.h
+// A multipattern finds many needles (patterns) in a haystack in a single
+// pass, using the Aho-Corasick automaton: a trie of the patterns where
+// every node also has a failure link to the longest proper suffix of it
+// that is in the trie (the same idea as the KMP table of is_substring,
+// for many needles at once).
+//
+// Patterns are added first; multipattern_freeze then compiles the
+// automaton, after which patterns can no longer be added and the
+// multipattern can be searched any number of times (also by several
+// threads at once, since searching does not modify it).
+
+struct multipattern;
+
+// NOTES: All of the following functions REQUIRE:
+//        pointers to a multipattern (e.g., mp) are valid (not NULL)
+//
+//       For times, m is the total length of the patterns
+
+// multipattern_create() returns a pointer to a new multipattern with no
+//   patterns
+// effects: allocates memory (caller must call multipattern_destroy)
+// time: O(1)
+struct multipattern *multipattern_create(void);
+
+// multipattern_destroy(mp) frees all dynamically allocated memory
+// effects: the memory at mp is invalid (freed)
+// time: O(1)
+void multipattern_destroy(struct multipattern *mp);
+
+// multipattern_add(mp, pattern, len) adds the len bytes of pattern to mp
+//   and returns it's id: 0 for the first pattern added, 1 for the next...
+// requires: mp is not frozen, len >= 1, pattern is valid for len bytes
+// effects: modifies mp
+// time: O(len * s) amortized, where s is the most children any node of
+//   the trie has (at most 256)
+int multipattern_add(struct multipattern *mp, const char *pattern,
+                     size_t len);
+
+// multipattern_freeze(mp) compiles the automaton of mp
+// requires: mp is not frozen
+// effects: modifies mp
+// time: O(m)
+void multipattern_freeze(struct multipattern *mp);
+
+// multipattern_search(mp, haystack, n, match, ctx) calls
+//   match(id, offset, ctx) for every match of every pattern of mp in the
+//   n bytes of haystack (unless match is NULL), where offset is the
+//   offset of the start of the match, in order of where matches end
+//   (patterns that end at the same byte come longest first), and returns
+//   the number of matches
+// requires: mp is frozen, haystack is valid for n bytes
+// effects: calls match
+// time: O(n + k), where k is the number of matches
+size_t multipattern_search(const struct multipattern *mp,
+                           const char *haystack, size_t n,
+                           void (*match)(int id, long long offset,
+                                         void *ctx),
+                           void *ctx);
+
+
+
+#include "multipattern.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// the root and the nodes up to DENSE_DEPTH bytes below it (but no more
+// than MAX_DENSE nodes in all) have a dense row of 256 transitions, so
+// the busy top of the automaton is one array lookup per byte; deeper
+// nodes keep only their trie edges, sorted by byte, and fall back along
+// failure links
+#define DENSE_DEPTH 2
+#define MAX_DENSE 256
+
+// while patterns are added, the children of a trie node are a linked
+// list (child, then sibling)
+struct buildnode {
+  int child;
+  int sibling;
+  unsigned char byte;
+  int out;
+};
+
+// fail is the node of the longest proper suffix that is in the trie
+// dict is the nearest node along failure links that ends a pattern
+//   (0 if there is none)
+// out is the first pattern that ends at the node (-1 if none); the rest
+//   are linked through nextout
+// the trie edges of the node are edges[first ... first + nedges - 1]
+// dense is the row of the node in dense, or -1
+struct acnode {
+  int fail;
+  int dict;
+  int out;
+  int first;
+  int nedges;
+  int dense;
+};
+
+struct acedge {
+  unsigned char byte;
+  int to;
+};
+
+// before it is frozen, mp is a trie of buildnodes (node 0 is the root);
+// freezing numbers the nodes in breadth first order and builds nodes,
+// edges and dense instead
+struct multipattern {
+  bool frozen;
+  int npatterns;
+  int maxpatterns;
+  int *lens;
+  int *nextout;
+  struct buildnode *trie;
+  int nnodes;
+  int maxnodes;
+  struct acnode *nodes;
+  struct acedge *edges;
+  int *dense;
+};
+
+struct multipattern *multipattern_create(void) {
+  struct multipattern *new = malloc(sizeof(struct multipattern));
+  new->frozen = false;
+  new->npatterns = 0;
+  new->maxpatterns = 16;
+  new->lens = malloc(sizeof(int) * new->maxpatterns);
+  new->nextout = malloc(sizeof(int) * new->maxpatterns);
+  new->maxnodes = 64;
+  new->trie = malloc(sizeof(struct buildnode) * new->maxnodes);
+  new->trie[0].child = -1;
+  new->trie[0].sibling = -1;
+  new->trie[0].byte = 0;
+  new->trie[0].out = -1;
+  new->nnodes = 1;
+  new->nodes = NULL;
+  new->edges = NULL;
+  new->dense = NULL;
+  return new;
+}
+
+void multipattern_destroy(struct multipattern *mp) {
+  free(mp->lens);
+  free(mp->nextout);
+  free(mp->trie);
+  free(mp->nodes);
+  free(mp->edges);
+  free(mp->dense);
+  free(mp);
+}
+
+// build_child(mp, v, byte) produces the child of trie node v for byte,
+// adding it if it is not there yet
+// effects: may modify mp
+// time: O(d), where d is the number of children of v
+static int build_child(struct multipattern *mp, int v, unsigned char byte) {
+  for (int c = mp->trie[v].child; c >= 0; c = mp->trie[c].sibling) {
+    if (mp->trie[c].byte == byte) return c;
+  }
+  if (mp->nnodes == mp->maxnodes) {
+    mp->maxnodes *= 2;
+    mp->trie = realloc(mp->trie, sizeof(struct buildnode) * mp->maxnodes);
+  }
+  int c = mp->nnodes++;
+  mp->trie[c].child = -1;
+  mp->trie[c].sibling = mp->trie[v].child;
+  mp->trie[c].byte = byte;
+  mp->trie[c].out = -1;
+  mp->trie[v].child = c;
+  return c;
+}
+
+int multipattern_add(struct multipattern *mp, const char *pattern,
+                     size_t len) {
+  assert(!mp->frozen && len >= 1);
+  int v = 0;
+  for (size_t i = 0; i < len; i++) {
+    v = build_child(mp, v, pattern[i]);
+  }
+  if (mp->npatterns == mp->maxpatterns) {
+    mp->maxpatterns *= 2;
+    mp->lens = realloc(mp->lens, sizeof(int) * mp->maxpatterns);
+    mp->nextout = realloc(mp->nextout, sizeof(int) * mp->maxpatterns);
+  }
+  int id = mp->npatterns++;
+  mp->lens[id] = len;
+  mp->nextout[id] = mp->trie[v].out;
+  mp->trie[v].out = id;
+  return id;
+}
+
+// edge_find(mp, v, byte) produces the trie child of frozen node v for
+// byte, or -1 if it has none
+// time: O(log d), where d is the number of children of v
+static int edge_find(const struct multipattern *mp, int v,
+                     unsigned char byte) {
+  const struct acedge *edges = mp->edges + mp->nodes[v].first;
+  int lo = 0;
+  int hi = mp->nodes[v].nedges;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (edges[mid].byte < byte) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < mp->nodes[v].nedges && edges[lo].byte == byte) {
+    return edges[lo].to;
+  }
+  return -1;
+}
+
+// step(mp, v, byte) produces the node the automaton moves to from node v
+// on byte
+// requires: the dense row of the root, and of every dense node on the
+//           failure links of v, is built
+// time: O(1) amortized over a search
+static int step(const struct multipattern *mp, int v, unsigned char byte) {
+  while (1) {
+    const struct acnode *node = &mp->nodes[v];
+    if (node->dense >= 0) return mp->dense[node->dense * 256 + byte];
+    int to = edge_find(mp, v, byte);
+    if (to >= 0) return to;
+    v = node->fail;
+  }
+}
+
+// compare_edges(a, b) orders edges by byte, for qsort
+static int compare_edges(const void *a, const void *b) {
+  return ((const struct acedge *)a)->byte - ((const struct acedge *)b)->byte;
+}
+
+void multipattern_freeze(struct multipattern *mp) {
+  assert(!mp->frozen);
+  int n = mp->nnodes;
+  // number the trie nodes in breadth first order: order[k] is the trie
+  // node that becomes node k, and depth[k] is it's depth
+  int *order = malloc(sizeof(int) * n);
+  int *number = malloc(sizeof(int) * n);
+  int *depth = malloc(sizeof(int) * n);
+  order[0] = 0;
+  number[0] = 0;
+  depth[0] = 0;
+  int len = 1;
+  for (int k = 0; k < len; k++) {
+    for (int c = mp->trie[order[k]].child; c >= 0; c = mp->trie[c].sibling) {
+      number[c] = len;
+      depth[len] = depth[k] + 1;
+      order[len++] = c;
+    }
+  }
+  mp->nodes = malloc(sizeof(struct acnode) * n);
+  mp->edges = malloc(sizeof(struct acedge) * (n > 1 ? n - 1 : 1));
+  int nedges = 0;
+  int ndense = 0;
+  for (int k = 0; k < n; k++) {
+    struct acnode *node = &mp->nodes[k];
+    node->out = mp->trie[order[k]].out;
+    node->first = nedges;
+    for (int c = mp->trie[order[k]].child; c >= 0; c = mp->trie[c].sibling) {
+      mp->edges[nedges].byte = mp->trie[c].byte;
+      mp->edges[nedges].to = number[c];
+      nedges++;
+    }
+    node->nedges = nedges - node->first;
+    qsort(mp->edges + node->first, node->nedges, sizeof(struct acedge),
+          compare_edges);
+    node->dense = -1;
+    if (depth[k] <= DENSE_DEPTH && ndense < MAX_DENSE) node->dense = ndense++;
+  }
+  // the failure link of a child of v on byte is where the automaton
+  // moves from fail(v) on byte; nodes are visited in breadth first
+  // order, so every node (and dense row) step needs is already done
+  mp->dense = malloc(sizeof(int) * 256 * ndense);
+  for (int k = 0; k < n; k++) {
+    struct acnode *node = &mp->nodes[k];
+    if (k == 0) {
+      node->fail = 0;
+      node->dict = 0;
+    }
+    if (node->dense >= 0) {
+      int *row = mp->dense + node->dense * 256;
+      for (int byte = 0; byte < 256; byte++) {
+        row[byte] = k == 0 ? 0 : step(mp, node->fail, byte);
+      }
+      for (int e = node->first; e < node->first + node->nedges; e++) {
+        row[mp->edges[e].byte] = mp->edges[e].to;
+      }
+    }
+    for (int e = node->first; e < node->first + node->nedges; e++) {
+      struct acnode *child = &mp->nodes[mp->edges[e].to];
+      child->fail = k == 0 ? 0 : step(mp, node->fail, mp->edges[e].byte);
+      const struct acnode *fail = &mp->nodes[child->fail];
+      child->dict = fail->out >= 0 ? child->fail : fail->dict;
+    }
+  }
+  free(order);
+  free(number);
+  free(depth);
+  free(mp->trie);
+  mp->trie = NULL;
+  mp->frozen = true;
+}
+
+size_t multipattern_search(const struct multipattern *mp,
+                           const char *haystack, size_t n,
+                           void (*match)(int id, long long offset,
+                                         void *ctx),
+                           void *ctx) {
+  assert(mp->frozen);
+  size_t count = 0;
+  int v = 0;
+  for (size_t pos = 0; pos < n; pos++) {
+    v = step(mp, v, haystack[pos]);
+    const struct acnode *node = &mp->nodes[v];
+    int u = node->out >= 0 ? v : node->dict;
+    while (u != 0) {
+      for (int id = mp->nodes[u].out; id >= 0; id = mp->nextout[id]) {
+        if (match) match(id, (long long)pos + 1 - mp->lens[id], ctx);
+        count++;
+      }
+      u = mp->nodes[u].dict;
+    }
+  }
+  return count;
+}
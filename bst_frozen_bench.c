@@ -0,0 +1,101 @@
+// Lookups in a frozen bst against the pointer tree it was made from,
+// for 1M, 10M and 100M keys: for the same QUERIES random keys (about a
+// third of them present) it times bst_find, bst_frozen_find,
+// bst_frozen_rank and bst_frozen_rank_batch, and prints the average
+// time of one lookup in ns. The pointer tree is built by
+// sorted_array_to_bst, so it's nodes are in allocation order; a tree
+// built by random inserts would be slower still.
+//
+// bst.h is the header part at the top of bst_fun.c. Build with e.g.
+//   gcc -std=c99 -O2 -pthread bst_fun.c bst_frozen_bench.c
+//       -o bst_frozen_bench
+//   ./bst_frozen_bench [max millions of keys]        (default 100)
+// 100M keys need about 5GB of memory.
+
+#include "bst.h"
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+
+#define QUERIES (1 << 22)
+#define BATCH 1024
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r ^ *r >> 16;
+}
+
+// lookups(which, q, t, f) runs lookup which for every key of q and
+//   produces the number found (or the sum of the ranks)
+static long long lookups(int which, const int *q, struct bst *t,
+                         const struct bst_frozen *f) {
+  long long sum = 0;
+  int ranks[BATCH];
+  for (int j = 0; j < QUERIES; j += which == 3 ? BATCH : 1) {
+    if (which == 0) {
+      sum += bst_find(q[j], t);
+    } else if (which == 1) {
+      sum += bst_frozen_find(q[j], f);
+    } else if (which == 2) {
+      sum += bst_frozen_rank(q[j], f);
+    } else {
+      bst_frozen_rank_batch(q + j, BATCH, ranks, f);
+      for (int k = 0; k < BATCH; k++) {
+        sum += ranks[k];
+      }
+    }
+  }
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  int max = argc > 1 ? atoi(argv[1]) : 100;
+  int *q = malloc(sizeof(int) * QUERIES);
+  const char *names[] = {"bst_find", "frozen_find", "frozen_rank",
+                         "rank_batch"};
+  printf("%-8s %12s %12s %12s %12s   (ns/lookup)\n", "keys", names[0],
+         names[1], names[2], names[3]);
+  for (int millions = 1; millions <= max; millions *= 10) {
+    int n = millions * 1000000;
+    // the keys are 0, 3, 6, ...
+    int *a = malloc(sizeof(int) * n);
+    for (int j = 0; j < n; j++) {
+      a[j] = 3 * j;
+    }
+    struct bst *t = sorted_array_to_bst(a, n);
+    free(a);
+    struct bst_frozen *f = bst_freeze(t);
+    unsigned r = 42;
+    for (int j = 0; j < QUERIES; j++) {
+      q[j] = next_random(&r) % (3u * n);
+    }
+    printf("%-8d", n);
+    long long found = lookups(0, q, t, f);
+    long long rank = 0;
+    for (int which = 0; which < 4; which++) {
+      double start = now();
+      long long sum = lookups(which, q, t, f);
+      double elapsed = now() - start;
+      if (which == 2) rank = sum;
+      assert(which < 2 ? sum == found : which == 2 || sum == rank);
+      printf(" %12.1f", elapsed / QUERIES * 1e9);
+      fflush(stdout);
+    }
+    printf("\n");
+    bst_frozen_destroy(f);
+    bst_destroy(t);
+  }
+  free(q);
+}
@@ -5,6 +5,10 @@
 //
 //       For times, n is the size of the tree
 //       For times, h is the height of the tree
+//
+//       The tree is kept AVL balanced by bst_insert and bst_remove
+//       (the heights of the two subtrees of every node differ by at
+//       most 1), so h is O(logn)
 
 extern const int PRE_ORDER;
 extern const int IN_ORDER;
@@ -15,10 +19,36 @@ struct bstnode {
   struct bstnode *left;
   struct bstnode *right;
   int size;                // NEW !
+  int height;
 };
 
+// nodes are carved out of slabs owned by the tree
+struct bstslab;
+
 struct bst {
     struct bstnode *root;
+    struct bstslab *slabs;   // newest slab first
+    struct bstnode *free;    // removed nodes, linked through left
+};
+
+// BST_MAX_HEIGHT is an upper bound on the height of any bst
+//   (an AVL tree with INT_MAX nodes is less than 46 levels high)
+#define BST_MAX_HEIGHT 64
+
+// a bst_iter walks the items of a bst in PRE_ORDER, IN_ORDER or
+//   POST_ORDER with an explicit stack, so it needs no recursion and
+//   no allocation; it is invalid once the bst is modified
+struct bst_iter {
+  struct bstnode *stack[BST_MAX_HEIGHT];
+  int top;
+  int order;
+};
+
+// a bst_cursor walks the items of a bst that are in a range
+//   in sorted order; it is invalid once the bst is modified
+struct bst_cursor {
+  struct bst_iter it;
+  int end;
 };
 
 // bst_create() returns a pointer to a new (empty) bst
@@ -26,16 +56,17 @@ struct bst {
 // time: O(1)
 struct bst *bst_create(void);
 
-// ino(node,a,pos) stores the item from the node in the array at index *pos
+// ino(node,a,pos) stores the items from node and it's children in
+//   sorted order in the array, starting at index *pos
 // requires: a is valid
 //           pos is valid
 // effect: modifies array a and modifies the value of pos
-// time: O(1)
+// time: O(n), where n is the size of node
 void ino(struct bstnode *node, int* a, int* pos);
 
 // bst_destroy(pq) frees all dynamically allocated memory 
 // effects: the memory at t is invalid (freed)
-// time: O(n)
+// time: O(s), where s is the number of slabs
 void bst_destroy(struct bst *t);
 
 // bst_size(t) returns the number of nodes in the bst
@@ -44,7 +75,7 @@ int bst_size(struct bst *t);
 
 // bst_insert(i, t) inserts the item i into the bst t
 // effects: modifies t if i is not already in t
-// time: O(h)
+// time: O(logn)
 void bst_insert(int i, struct bst *t);
 
 // bst_find(i, t) determines if i is in t
@@ -58,14 +89,54 @@ int bst_select(int k, struct bst *t);
 
 // bst_remove(i, t) removes i from bst t if it exists
 // effects: modifies t if i is in t
-// time: O(h)
+// time: O(logn)
 void bst_remove (int i, struct bst *t);
 
 // bst_range(start, end, t) returns the number of items in t that are 
 //   between the values of start and end (inclusive)
-// time: O(n)
+// time: O(h)
 int bst_range (int start, int end, struct bst *t);
 
+// bst_range_copy(start, end, t, a, len) stores the items in t that are
+//   between the values of start and end (inclusive) into a in sorted
+//   order, stopping after len items, and returns how many were stored
+// requires: a has room for len items
+// effects: modifies a
+// time: O(h + k), where k is the number of items stored
+int bst_range_copy(int start, int end, struct bst *t, int *a, int len);
+
+// bst_cursor_range(c, start, end, t) positions c before the smallest
+//   item in t that is >= start; c stops after the last item <= end
+// effects: modifies c
+// time: O(h)
+void bst_cursor_range(struct bst_cursor *c, int start, int end,
+                      struct bst *t);
+
+// bst_cursor_next(c, i) stores the next item of c in *i and returns true,
+//   or returns false if c has no more items
+// effects: modifies c, and *i if it returns true
+// time: O(1) amortized, O(h) worst case
+bool bst_cursor_next(struct bst_cursor *c, int *i);
+
+// bst_iter_begin(it, o, t) positions it before the first item of t
+//   in order o
+// requires: o is a valid order
+// effects: modifies it
+// time: O(h)
+void bst_iter_begin(struct bst_iter *it, int o, struct bst *t);
+
+// bst_iter_seek(it, i, t) positions it before the smallest item in t
+//   that is >= i; it then walks the rest of t IN_ORDER
+// effects: modifies it
+// time: O(h)
+void bst_iter_seek(struct bst_iter *it, int i, struct bst *t);
+
+// bst_iter_next(it, i) stores the next item of it in *i and returns true,
+//   or returns false if it has no more items
+// effects: modifies it and *i
+// time: O(1) amortized, O(h) worst case
+bool bst_iter_next(struct bst_iter *it, int *i);
+
 // bst_print(o, t) prints the bst to the screen in order o
 // example: given a bst with the following structure
 //             4
@@ -79,7 +150,7 @@ int bst_range (int start, int end, struct bst *t);
 //   if the t is empty, prints "[empty]\n"
 // requires: o is a valid order
 // effects: displays output
-// time: O(n)
+// time: O(n), using O(h) memory
 void bst_print (int o, struct bst *t);
 
 // bst_to_sorted_array(t) returns a pointer to a new array
@@ -101,41 +172,292 @@ struct bst *sorted_array_to_bst(int *a, int len);
 
 // bst_rebalance(t) changes t so that it contains all of the same items,
 //   but the tree is balanced
+// note: bst_insert and bst_remove already keep t balanced, so this is
+//   only needed to get the minimum possible height
+//   the existing nodes are relinked in place; nothing is allocated
 // effects: modifies t
-// time: O(nlogn)
+// time: O(n)
 void bst_rebalance(struct bst *t);
 
+// bst_rebalance_partial(slack, t) rebuilds, in place and with the
+//   minimum possible height, only the largest subtrees of t whose height
+//   is more than slack above the minimum possible for their size
+// requires: slack >= 0
+// effects: modifies t
+// time: O(n)
+void bst_rebalance_partial(int slack, struct bst *t);
+
+// the _parallel versions below split the work between up to threads
+//   threads (fork-join), and fall back to one thread for small trees
+
+// sorted_array_to_bst_parallel(a, len, threads) is sorted_array_to_bst
+//   using up to threads threads
+// requires: same as sorted_array_to_bst, threads >= 1
+// time: O(n / threads + logn)
+struct bst *sorted_array_to_bst_parallel(int *a, int len, int threads);
+
+// bst_to_sorted_array_parallel(threads, t) is bst_to_sorted_array using
+//   up to threads threads
+// requires: threads >= 1
+// effects : allocates memory (caller must free)
+// time: O(n / threads + logn)
+int *bst_to_sorted_array_parallel(int threads, struct bst *t);
+
+// bst_rebalance_parallel(threads, t) is bst_rebalance using up to
+//   threads threads
+// note: unlike bst_rebalance, this copies the items to a new array and
+//   rebuilds t in one new slab, so it needs O(n) extra memory
+// requires: threads >= 1
+// effects: modifies t
+// time: O(n / threads + logn)
+void bst_rebalance_parallel(int threads, struct bst *t);
+
+// bst_insert_batch(a, len, t) inserts the len items of a into t
+// note: a large batch is sorted and merged with the items of t, and t
+//   is rebuilt balanced; a small batch is inserted one item at a time
+// requires: a is valid, len >= 0
+// effects: modifies t
+// time: O(min(n + klogk, klogn)), where k is len
+void bst_insert_batch(int *a, int len, struct bst *t);
+
+// bst_remove_batch(a, len, t) removes the len items of a from t
+//   (items that are not in t are ignored)
+// requires: a is valid, len >= 0
+// effects: modifies t
+// time: O(min(n + klogk, klogn)), where k is len
+void bst_remove_batch(int *a, int len, struct bst *t);
+
+// bst_union(a, b) returns a new balanced bst with the items that are
+//   in a or in b
+// effects: allocates memory (caller must call bst_destroy)
+// time: O(n + m), where m is the size of b
+struct bst *bst_union(struct bst *a, struct bst *b);
+
+// bst_intersection(a, b) returns a new balanced bst with the items that
+//   are in both a and b
+// effects: allocates memory (caller must call bst_destroy)
+// time: O(n + m), where m is the size of b
+struct bst *bst_intersection(struct bst *a, struct bst *b);
+
+// bst_difference(a, b) returns a new balanced bst with the items that
+//   are in a but not in b
+// effects: allocates memory (caller must call bst_destroy)
+// time: O(n + m), where m is the size of b
+struct bst *bst_difference(struct bst *a, struct bst *b);
+
+// a bst_frozen is a read-only copy of a bst, stored as an implicit tree
+//   in breadth-first (Eytzinger) order so that every search descends
+//   through one array and the next levels can be prefetched
+struct bst_frozen;
+
+// bst_freeze(t) returns a new bst_frozen with the same items as t
+// effects: allocates memory (caller must call bst_frozen_destroy)
+// time: O(n)
+struct bst_frozen *bst_freeze(struct bst *t);
+
+// bst_frozen_destroy(f) frees all dynamically allocated memory
+// effects: the memory at f is invalid (freed)
+// time: O(1)
+void bst_frozen_destroy(struct bst_frozen *f);
+
+// bst_frozen_size(f) returns the number of items in f
+// time: O(1)
+int bst_frozen_size(const struct bst_frozen *f);
+
+// bst_frozen_find(i, f) determines if i is in f
+// time: O(logn)
+bool bst_frozen_find(int i, const struct bst_frozen *f);
+
+// bst_frozen_select(k, f) returns the k'th element from f in sorted order
+// requires: 0 <= k < bst_frozen_size(f)
+// time: O(1)
+int bst_frozen_select(int k, const struct bst_frozen *f);
+
+// bst_frozen_rank(i, f) returns the number of items in f less than i
+// time: O(logn)
+int bst_frozen_rank(int i, const struct bst_frozen *f);
+
+// bst_frozen_rank_batch(items, n, ranks, f) stores bst_frozen_rank of
+//   items[j] in ranks[j] for every j < n; the searches descend together,
+//   8 at a time, so their cache misses overlap
+// requires: items and ranks are valid, n >= 0
+// effects: modifies ranks
+// time: O(nlogn)
+void bst_frozen_rank_batch(const int *items, int n, int *ranks,
+                           const struct bst_frozen *f);
+
+// bst_frozen_range(start, end, f) returns the number of items in f that
+//   are between the values of start and end (inclusive)
+// time: O(logn)
+int bst_frozen_range(int start, int end, const struct bst_frozen *f);
+
+// bst_save(t, path) writes a frozen copy of t to the file at path and
+//   returns true, or returns false if the file could not be written
+// note: the file holds a versioned header, a checksum and the arrays of
+//   a bst_frozen, using offsets only, in the byte order of this machine
+// effects: creates or replaces the file at path
+// time: O(n)
+bool bst_save(struct bst *t, const char *path);
+
+// bst_open_mapped(path) returns a bst_frozen that reads a file written
+//   by bst_save directly through a memory mapping, or returns NULL if
+//   the file can not be mapped or is not in the format of bst_save
+// note: only the header is checked; call bst_frozen_verify to check
+//   the items against the checksum
+// effects: allocates memory (caller must call bst_frozen_destroy)
+// time: O(1)
+struct bst_frozen *bst_open_mapped(const char *path);
+
+// bst_frozen_verify(f) determines if the items of f match the checksum
+//   they were saved with (always true if f was not opened from a file)
+// time: O(n)
+bool bst_frozen_verify(const struct bst_frozen *f);
+
+// a bst_shared is a bst that many threads may use at the same time:
+//   readers take no locks and always see a complete tree, writers are
+//   serialized and copy the path they change (read-copy-update), and
+//   replaced nodes are reused only once no reader can still see them
+struct bst_shared;
+
+// bst_shared_create() returns a pointer to a new (empty) bst_shared
+// effects: allocates memory (caller must call bst_shared_destroy)
+// time: O(1)
+struct bst_shared *bst_shared_create(void);
+
+// bst_shared_destroy(s) frees all dynamically allocated memory
+// requires: no other thread is using s
+// effects: the memory at s is invalid (freed)
+// time: O(s), where s is the number of slabs
+void bst_shared_destroy(struct bst_shared *s);
+
+// bst_shared_size(s) returns the number of nodes in s
+// time: O(1)
+int bst_shared_size(struct bst_shared *s);
+
+// bst_shared_insert(i, s) inserts the item i into s
+// effects: modifies s if i is not already in s
+//          waits for other writers, and sometimes for readers that
+//          started before an earlier write
+// time: O(logn)
+void bst_shared_insert(int i, struct bst_shared *s);
+
+// bst_shared_remove(i, s) removes i from s if it exists
+// effects: modifies s if i is in s
+//          waits like bst_shared_insert
+// time: O(logn)
+void bst_shared_remove(int i, struct bst_shared *s);
+
+// bst_shared_find(i, s) determines if i is in s
+// time: O(logn)
+bool bst_shared_find(int i, struct bst_shared *s);
+
+// bst_shared_select(k, s, i) stores the k'th element from s in sorted
+//   order in *i and returns true, or returns false if s has k or fewer
+//   items when it is read
+// effects: modifies *i
+// time: O(logn)
+bool bst_shared_select(int k, struct bst_shared *s, int *i);
+
+// bst_shared_range(start, end, s) returns the number of items in s that
+//   are between the values of start and end (inclusive)
+// time: O(logn)
+int bst_shared_range(int start, int end, struct bst_shared *s);
+
 
 
 #include "bst.h"
+#define _POSIX_C_SOURCE 200809L   // posix_memalign
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 const int PRE_ORDER = 0;
 const int IN_ORDER = 1;
 const int POST_ORDER = 2;
 
+// slabs grown by bst_insert start with MIN_SLAB nodes and double up to
+// MAX_SLAB nodes; bulk builds use one slab of exactly the needed size
+static const int MIN_SLAB = 64;
+static const int MAX_SLAB = 65536;
+
+struct bstslab {
+  struct bstslab *next;
+  int len;
+  int used;
+  struct bstnode nodes[];
+};
+
 struct bst *bst_create(void) {
   struct bst *new = malloc( sizeof(struct bst) );
   new->root = NULL;
+  new->slabs = NULL;
+  new->free = NULL;
   return new;
 }
 
+// slab_add(t,len) adds a new slab with room for len nodes to t
+// effects: allocates memory (freed by slabs_clear)
+// time: O(1)
+static struct bstslab *slab_add(struct bst *t, int len) {
+  struct bstslab *new = malloc(sizeof(struct bstslab) +
+                               sizeof(struct bstnode) * len);
+  new->next = t->slabs;
+  new->len = len;
+  new->used = 0;
+  t->slabs = new;
+  return new;
+}
+
+// slabs_clear(t) frees every slab of t, and so every node of t
+// effects: the nodes of t are invalid (freed), t is emptied
+// time: O(s), where s is the number of slabs
+static void slabs_clear(struct bst *t) {
+  while (t->slabs) {
+    struct bstslab *next = t->slabs->next;
+    free(t->slabs);
+    t->slabs = next;
+  }
+  t->root = NULL;
+  t->free = NULL;
+}
 
-// bstnode_destroy frees the node and all it's children.
-// effect: the memory at node is invalid (freed)
-// runtime : O(n)
-static void bstnode_destroy (struct bstnode *node) {
-  if ( node ) {
-    bstnode_destroy (node->left);
-    bstnode_destroy (node->right);
-    free(node);
+// node_alloc(t) produces an uninitialized node owned by t, reusing a
+// removed node if there is one
+// effects: may allocate a new slab
+// time: O(1)
+static struct bstnode *node_alloc(struct bst *t) {
+  if (t->free) {
+    struct bstnode *node = t->free;
+    t->free = node->left;
+    return node;
   }
+  struct bstslab *slab = t->slabs;
+  if (slab == NULL || slab->used == slab->len) {
+    int len = MIN_SLAB;
+    if (slab) len = slab->len < MAX_SLAB / 2 ? 2 * slab->len : MAX_SLAB;
+    slab = slab_add(t, len);
+  }
+  return &slab->nodes[slab->used++];
+}
+
+// node_free(t,node) gives node back to t to be reused by node_alloc
+// effects: node is invalid
+// time: O(1)
+static void node_free(struct bst *t, struct bstnode *node) {
+  node->left = t->free;
+  t->free = node;
 }
 
 void bst_destroy(struct bst *t) {
-  bstnode_destroy(t->root);
+  slabs_clear(t);
   free(t);
 }
 
@@ -166,23 +488,111 @@ bool bst_find(int i, struct bst *t) {
   return false;
 }
 
-void bst_insert(int i, struct bst *t) {
-  if (bst_find (i,t)) return;
-  struct bstnode **controll = &(t->root);
-  while (*controll) {
-    if (i < (*controll)->item) {
-      (*controll)->size++;
-      controll = &((*controll)->left);
-    } else {
-      (*controll)->size++;
-      controll = &((*controll)->right);
+// node_size(node) produces the number of nodes in node and it's children
+// time: O(1)
+static int node_size(struct bstnode *node) {
+  if (node) return node->size;
+  return 0;
+}
+
+// node_height(node) produces the height of node, 0 for an empty node
+// time: O(1)
+static int node_height(struct bstnode *node) {
+  if (node) return node->height;
+  return 0;
+}
+
+// node_update(node) recomputes the size and height of node from it's
+// children
+// effects: modifies node
+// time: O(1)
+static void node_update(struct bstnode *node) {
+  int lh = node_height(node->left);
+  int rh = node_height(node->right);
+  node->size = node_size(node->left) + node_size(node->right) + 1;
+  node->height = (lh > rh ? lh : rh) + 1;
+}
+
+// rotate_right(node) lifts the left child of node into it's place and
+// produces the new root of the subtree
+// requires: node->left is not NULL
+// effects: modifies node and it's left child
+// time: O(1)
+static struct bstnode *rotate_right(struct bstnode *node) {
+  struct bstnode *top = node->left;
+  node->left = top->right;
+  top->right = node;
+  node_update(node);
+  node_update(top);
+  return top;
+}
+
+// rotate_left(node) lifts the right child of node into it's place and
+// produces the new root of the subtree
+// requires: node->right is not NULL
+// effects: modifies node and it's right child
+// time: O(1)
+static struct bstnode *rotate_left(struct bstnode *node) {
+  struct bstnode *top = node->right;
+  node->right = top->left;
+  top->left = node;
+  node_update(node);
+  node_update(top);
+  return top;
+}
+
+// node_balance(node) updates node and restores the AVL property at node
+// with at most two rotations, then produces the new root of the subtree
+// requires: both children of node are AVL balanced and their heights
+//           differ by at most 2
+// effects: modifies node and it's children
+// time: O(1)
+static struct bstnode *node_balance(struct bstnode *node) {
+  int diff = node_height(node->left) - node_height(node->right);
+  if (diff > 1) {
+    if (node_height(node->left->left) < node_height(node->left->right)) {
+      node->left = rotate_left(node->left);
     }
+    return rotate_right(node);
   }
-  *controll = malloc(sizeof(struct bstnode));
-  (*controll)->item = i;
-  (*controll)->left = NULL;
-  (*controll)->right = NULL;
-  (*controll)->size = 1;
+  if (diff < -1) {
+    if (node_height(node->right->right) < node_height(node->right->left)) {
+      node->right = rotate_right(node->right);
+    }
+    return rotate_left(node);
+  }
+  node_update(node);
+  return node;
+}
+
+// node_insert(i,node,t) inserts the item i among node and it's children
+// and produces the new (balanced) root of the subtree
+// effects: modifies node if i is not already in it
+//          new nodes are allocated from t
+// time: O(logn)
+static struct bstnode *node_insert(int i, struct bstnode *node,
+                                   struct bst *t) {
+  if (node == NULL) {
+    struct bstnode *new = node_alloc(t);
+    new->item = i;
+    new->left = NULL;
+    new->right = NULL;
+    new->size = 1;
+    new->height = 1;
+    return new;
+  }
+  if (i < node->item) {
+    node->left = node_insert(i, node->left, t);
+  } else if (i > node->item) {
+    node->right = node_insert(i, node->right, t);
+  } else {
+    return node;
+  }
+  return node_balance(node);
+}
+
+void bst_insert(int i, struct bst *t) {
+  t->root = node_insert(i, t->root, t);
 }
 
 // select(k,node) produces the k-th smallest element from node and it's children
@@ -201,82 +611,109 @@ int bst_select(int k, struct bst *t) {
   return select(k,t->root);
 }
 
-// node_remove(i,node) removes the item i from the nodes if it exists
+// node_remove(i,node,t) removes the item i from the nodes if it exists
+// and produces the new (balanced) root of the subtree
 // effects: modifies node if i is in t
-// time: O(h)
-struct bstnode *node_remove (int i, struct bstnode *node) {
+//          the removed node is given back to t
+// time: O(logn)
+struct bstnode *node_remove (int i, struct bstnode *node, struct bst *t) {
   if(node == NULL) return NULL;
   if (i < node->item) {
-    node->size--;
-    node->left = node_remove(i,node->left);
+    node->left = node_remove(i,node->left,t);
+  } else if (i > node->item) {
+    node->right = node_remove(i,node->right,t);
   } else {
-    if (i > node->item) {
-      node->size--;
-      node->right = node_remove(i,node->right);
-    } else {
-      if (node -> left == NULL) {
-        struct bstnode *new = node->right;
-        free(node);
-        return new;
-      } else {
-        if (node -> right == NULL) {
-          struct bstnode *new = node->left;
-          free(node);
-          return new;
-        } else {
-          struct bstnode *next = node->right;
-          while (next->left) {
-            next = next->left;
-          }
-          node->item = next->item;
-          node->size--;
-          node->right = node_remove(next->item, node->right);
-        }
-      }
+    if (node -> left == NULL) {
+      struct bstnode *new = node->right;
+      node_free(t, node);
+      return new;
     }
+    if (node -> right == NULL) {
+      struct bstnode *new = node->left;
+      node_free(t, node);
+      return new;
+    }
+    struct bstnode *next = node->right;
+    while (next->left) {
+      next = next->left;
+    }
+    node->item = next->item;
+    node->right = node_remove(next->item, node->right, t);
   }
-  return node;
+  return node_balance(node);
 }
 
 void bst_remove (int i, struct bst *t) {
-  if ( bst_find(i,t) ) t->root = node_remove(i,t->root);
+  t->root = node_remove(i,t->root,t);
 }
 
-// compare(start,end,node) produces the number of items among node and 
-// it's children that is bigger than start and less than end, inclusive.
-// time: O(n)
-int compare(int start, int end, struct bstnode *node) {
-  if (node) {
-    int left = compare(start,end,node->left);
-    int right = compare(start,end,node->right);
-    if ( node->item >= start && node->item <= end ) {
-      return left + right + 1;
+// node_rank(i,inclusive,node) produces the number of items among node
+// and it's children that are less than i (or equal to i if inclusive)
+// time: O(h)
+static int node_rank(int i, bool inclusive, struct bstnode *node) {
+  int rank = 0;
+  while (node) {
+    if (node->item < i || (inclusive && node->item == i)) {
+      rank += node_size(node->left) + 1;
+      node = node->right;
     } else {
-      return left + right;
+      node = node->left;
     }
   }
-  return 0;
+  return rank;
 }
 
 int bst_range (int start, int end, struct bst *t) {
-  return compare(start,end,t->root);
+  if (start > end) return 0;
+  return node_rank(end, true, t->root) - node_rank(start, false, t->root);
+}
+
+void bst_cursor_range(struct bst_cursor *c, int start, int end,
+                      struct bst *t) {
+  bst_iter_seek(&c->it, start, t);
+  c->end = end;
+}
+
+bool bst_cursor_next(struct bst_cursor *c, int *i) {
+  int next;
+  if (!bst_iter_next(&c->it, &next)) return false;
+  if (next > c->end) {
+    c->it.top = 0;
+    return false;
+  }
+  *i = next;
+  return true;
+}
+
+int bst_range_copy(int start, int end, struct bst *t, int *a, int len) {
+  struct bst_cursor c;
+  int pos = 0;
+  bst_cursor_range(&c, start, end, t);
+  while (pos < len && bst_cursor_next(&c, &a[pos])) {
+    pos++;
+  }
+  return pos;
 }
 
 
-// binary_build (a,start,end) produces a balanced bst that contains items 
-// bewteen index start and end from the array a.
+// binary_build (a,start,end,nodes) produces a balanced bst that contains
+// items bewteen index start and end from the array a. The item a[k] is
+// stored in nodes[k], so the whole tree is contiguous in memory.
 // requires: a is sorted in ascending order, len >= 1,
 //           a contains no duplicates
+//           nodes has room for end + 1 nodes
+// effects: modifies nodes
 // time: O(n)
-struct bstnode *binary_build( int*a, int start, int end ) {
+struct bstnode *binary_build( int*a, int start, int end,
+                              struct bstnode *nodes ) {
   assert(a);
   if (start > end) return NULL;
   int mid = (start + end) / 2;
-  struct bstnode *new = malloc(sizeof(struct bstnode));
+  struct bstnode *new = &nodes[mid];
   new->item = a[mid];
-  new->size = end - start + 1;
-  new->left = binary_build(a,start,mid-1);
-  new->right = binary_build(a,mid+1,end);
+  new->left = binary_build(a,start,mid-1,nodes);
+  new->right = binary_build(a,mid+1,end,nodes);
+  node_update(new);
   return new;
 }
 
@@ -291,112 +728,995 @@ int *bst_to_sorted_array(struct bst *t) {
   }
 }
 
+// a subtree smaller than GRAIN nodes is always handled by one thread
+static const int GRAIN = 16384;
+
+// a buildtask is binary_build(a,start,end,nodes) run by up to threads
+// threads, with the root of the result stored in root
+struct buildtask {
+  int *a;
+  int start;
+  int end;
+  struct bstnode *nodes;
+  int threads;
+  struct bstnode *root;
+};
+
+// build_task(arg) runs the buildtask at arg, building the left half in
+// a new thread and the right half in this one
+// effects: modifies the buildtask and it's nodes
+// time: O(n / threads + logn)
+static void *build_task(void *arg) {
+  struct buildtask *task = arg;
+  if (task->threads <= 1 || task->end - task->start < GRAIN) {
+    task->root = binary_build(task->a, task->start, task->end, task->nodes);
+    return NULL;
+  }
+  int mid = (task->start + task->end) / 2;
+  struct buildtask left = {task->a, task->start, mid - 1, task->nodes,
+                           task->threads / 2, NULL};
+  struct buildtask right = {task->a, mid + 1, task->end, task->nodes,
+                            task->threads - task->threads / 2, NULL};
+  pthread_t thread;
+  bool forked = pthread_create(&thread, NULL, build_task, &left) == 0;
+  if (!forked) build_task(&left);
+  build_task(&right);
+  if (forked) pthread_join(thread, NULL);
+  task->root = &task->nodes[mid];
+  task->root->item = task->a[mid];
+  task->root->left = left.root;
+  task->root->right = right.root;
+  node_update(task->root);
+  return NULL;
+}
+
+// an exporttask is ino(node,a,&pos) with pos starting at 0, run by up
+// to threads threads
+struct exporttask {
+  struct bstnode *node;
+  int *a;
+  int threads;
+};
+
+// export_task(arg) runs the exporttask at arg; the size of the left
+// child tells where the node and the right child go in a, so the left
+// child is exported by a new thread
+// effects: modifies the array of the exporttask
+// time: O(n / threads + logn)
+static void *export_task(void *arg) {
+  struct exporttask *task = arg;
+  struct bstnode *node = task->node;
+  if (task->threads <= 1 || node_size(node) < GRAIN) {
+    int pos = 0;
+    ino(node, task->a, &pos);
+    return NULL;
+  }
+  int lsize = node_size(node->left);
+  struct exporttask left = {node->left, task->a, task->threads / 2};
+  struct exporttask right = {node->right, task->a + lsize + 1,
+                             task->threads - task->threads / 2};
+  pthread_t thread;
+  bool forked = pthread_create(&thread, NULL, export_task, &left) == 0;
+  if (!forked) export_task(&left);
+  task->a[lsize] = node->item;
+  export_task(&right);
+  if (forked) pthread_join(thread, NULL);
+  return NULL;
+}
+
+// slab_build(a,len,threads,t) replaces the nodes of t with a balanced
+// tree of the len items in a, all stored in one new slab, using up to
+// threads threads
+// requires: a is sorted in ascending order, len >= 1,
+//           a contains no duplicates
+//           threads >= 1
+// effects: modifies t
+// time: O(n / threads + logn + s), where s is the number of slabs of t
+static void slab_build(int *a, int len, int threads, struct bst *t) {
+  slabs_clear(t);
+  struct bstslab *slab = slab_add(t, len);
+  slab->used = len;
+  struct buildtask task = {a, 0, len - 1, slab->nodes, threads, NULL};
+  build_task(&task);
+  t->root = task.root;
+}
+
 struct bst *sorted_array_to_bst(int *a, int len) {
   struct bst *result = bst_create();
-  result->root = binary_build(a, 0, len-1);
+  slab_build(a, len, 1, result);
   return result;
 }
 
+// vine_from_tree(pseudo) rotates the tree at pseudo->right into a vine:
+// a chain of right children in sorted order (Day-Stout-Warren)
+// effects: modifies pseudo and the nodes of the tree
+// time: O(n)
+static void vine_from_tree(struct bstnode *pseudo) {
+  struct bstnode *tail = pseudo;
+  struct bstnode *rest = tail->right;
+  while (rest) {
+    if (rest->left) {
+      rest = rotate_right(rest);
+      tail->right = rest;
+    } else {
+      tail = rest;
+      rest = rest->right;
+    }
+  }
+}
+
+// vine_compress(pseudo,count) rotates left every second node of the
+// first 2 * count nodes of the vine at pseudo->right
+// effects: modifies pseudo and the nodes of the vine
+// time: O(count)
+static void vine_compress(struct bstnode *pseudo, int count) {
+  struct bstnode *scanner = pseudo;
+  for (int i = 0; i < count; i++) {
+    scanner->right = rotate_left(scanner->right);
+    scanner = scanner->right;
+  }
+}
+
+// node_refresh(node) recomputes the size and height of node and all it's
+// children, after rotations that left the heights of ancestors stale
+// effects: modifies node and it's children
+// time: O(n), with recursion as deep as the height of node
+static void node_refresh(struct bstnode *node) {
+  if (node) {
+    node_refresh(node->left);
+    node_refresh(node->right);
+    node_update(node);
+  }
+}
+
+// node_dsw(node) relinks node and it's children in place into a tree of
+// the minimum possible height and produces it's new root
+// effects: modifies node and it's children
+// time: O(n)
+static struct bstnode *node_dsw(struct bstnode *node) {
+  if (node == NULL) return NULL;
+  int len = node->size;
+  struct bstnode pseudo;
+  pseudo.right = node;
+  vine_from_tree(&pseudo);
+  int full = 1;
+  while (2 * full + 1 <= len) {
+    full = 2 * full + 1;
+  }
+  // first make the bottom level, then halve the vine level by level
+  vine_compress(&pseudo, len - full);
+  for (int rest = full / 2; rest > 0; rest /= 2) {
+    vine_compress(&pseudo, rest);
+  }
+  node_refresh(pseudo.right);
+  return pseudo.right;
+}
+
 void bst_rebalance(struct bst *t) {
+  t->root = node_dsw(t->root);
+}
+
+// min_height(len) produces the minimum possible height of a tree with
+// len nodes
+// time: O(logn)
+static int min_height(int len) {
+  int height = 0;
+  for (long long full = 0; full < len; full = 2 * full + 1) {
+    height++;
+  }
+  return height;
+}
+
+// node_rebalance_partial(slack,node) rebuilds the largest subtrees of
+// node whose height is more than slack above the minimum for their size
+// and produces the new root of node
+// effects: modifies node and it's children
+// time: O(n)
+static struct bstnode *node_rebalance_partial(int slack,
+                                              struct bstnode *node) {
+  if (node == NULL) return NULL;
+  if (node->height > min_height(node->size) + slack) {
+    return node_dsw(node);
+  }
+  node->left = node_rebalance_partial(slack, node->left);
+  node->right = node_rebalance_partial(slack, node->right);
+  node_update(node);
+  return node;
+}
+
+void bst_rebalance_partial(int slack, struct bst *t) {
+  assert(slack >= 0);
+  t->root = node_rebalance_partial(slack, t->root);
+}
+
+struct bst *sorted_array_to_bst_parallel(int *a, int len, int threads) {
+  assert(threads >= 1);
+  struct bst *result = bst_create();
+  slab_build(a, len, threads, result);
+  return result;
+}
+
+int *bst_to_sorted_array_parallel(int threads, struct bst *t) {
+  assert(threads >= 1);
+  if (t->root == NULL) return NULL;
+  int *result = malloc(sizeof(int) * bst_size(t));
+  struct exporttask task = {t->root, result, threads};
+  export_task(&task);
+  return result;
+}
+
+void bst_rebalance_parallel(int threads, struct bst *t) {
   if (t->root) {
-    int *sa = bst_to_sorted_array(t);
-    struct bstnode *result = binary_build(sa,0,t->root->size-1);
-    bstnode_destroy(t->root);
-    t->root = result;
+    int *sa = bst_to_sorted_array_parallel(threads, t);
+    slab_build(sa, t->root->size, threads, t);
     free(sa);
   }
 }
 
+// the set operations understood by merge
+static const int UNION = 0;
+static const int INTERSECTION = 1;
+static const int DIFFERENCE = 2;
+
+// merge(a,alen,b,blen,op,out) stores the items of the set operation op
+// applied to a and b into out in ascending order and produces how many
+// items were stored
+// requires: a and b are sorted in ascending order with no duplicates
+//           out has room for alen + blen items
+// effects: modifies out
+// time: O(alen + blen)
+static int merge(int *a, int alen, int *b, int blen, int op, int *out) {
+  int i = 0;
+  int j = 0;
+  int len = 0;
+  while (i < alen && j < blen) {
+    if (a[i] < b[j]) {
+      if (op != INTERSECTION) out[len++] = a[i];
+      i++;
+    } else if (a[i] > b[j]) {
+      if (op == UNION) out[len++] = b[j];
+      j++;
+    } else {
+      if (op != DIFFERENCE) out[len++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  if (op != INTERSECTION) {
+    while (i < alen) out[len++] = a[i++];
+  }
+  if (op == UNION) {
+    while (j < blen) out[len++] = b[j++];
+  }
+  return len;
+}
 
-// preo(node,a,pos) stores the item from the node in the array at index *pos
-// requires: a is valid
-//           pos is valid
-// effect: modifies array a and modifies the value of pos
-// time: O(1)
-void preo(struct bstnode *node, int* a, int* pos) {
-  if (node) {
-    a[*pos] = node->item;
-    (*pos)++;
-    preo(node->left,a,pos);
-    preo(node->right,a,pos);
+// int_cmp(a,b) compares two ints for qsort
+static int int_cmp(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+// small_batch(len,t) determines if inserting or removing len items from
+// t one at a time is cheaper than merging them with all of t
+// time: O(logn)
+static bool small_batch(int len, struct bst *t) {
+  long long cost = 0;
+  for (int n = bst_size(t); n > 0; n /= 2) {
+    cost += len;
   }
+  return cost < bst_size(t);
 }
 
-// ino(node,a,pos) stores the item from the node in the array at index *pos
-// requires: a is valid
-//           pos is valid
-// effect: modifies array a and modifies the value of pos
-// time: O(1)
-void ino(struct bstnode *node, int* a, int* pos) {
-  if (node) {
-    ino(node->left,a,pos);
-    a[*pos] = node->item;
-    (*pos)++;
-    ino(node->right,a,pos);
+// batch_merge(a,len,op,t) replaces the items of t with the set operation
+// op applied to the items of t and the len items of a
+// effects: modifies t
+// time: O(n + klogk), where k is len
+static void batch_merge(int *a, int len, int op, struct bst *t) {
+  int *batch = malloc(sizeof(int) * len);
+  int blen = 0;
+  for (int i = 0; i < len; i++) batch[i] = a[i];
+  qsort(batch, len, sizeof(int), int_cmp);
+  for (int i = 0; i < len; i++) {
+    if (blen == 0 || batch[blen - 1] != batch[i]) batch[blen++] = batch[i];
   }
+  int n = bst_size(t);
+  int *sa = bst_to_sorted_array(t);
+  int *result = malloc(sizeof(int) * (n + blen));
+  int rlen = merge(sa, n, batch, blen, op, result);
+  if (rlen > 0) {
+    slab_build(result, rlen, 1, t);
+  } else {
+    slabs_clear(t);
+  }
+  free(result);
+  free(sa);
+  free(batch);
 }
 
-// posto(node,a,pos) stores the item from the node in the array at index *pos
-// requires: a is valid
-//           pos is valid
-// effect: modifies array a and modifies the value of pos
+void bst_insert_batch(int *a, int len, struct bst *t) {
+  assert(a && len >= 0);
+  if (len == 0) return;
+  if (small_batch(len, t)) {
+    for (int i = 0; i < len; i++) bst_insert(a[i], t);
+  } else {
+    batch_merge(a, len, UNION, t);
+  }
+}
+
+void bst_remove_batch(int *a, int len, struct bst *t) {
+  assert(a && len >= 0);
+  if (len == 0 || t->root == NULL) return;
+  if (small_batch(len, t)) {
+    for (int i = 0; i < len; i++) bst_remove(a[i], t);
+  } else {
+    batch_merge(a, len, DIFFERENCE, t);
+  }
+}
+
+// set_build(a,b,op) produces a new bst with the set operation op applied
+// to the items of a and b
+// effects: allocates memory (caller must call bst_destroy)
+// time: O(n + m), where m is the size of b
+static struct bst *set_build(struct bst *a, struct bst *b, int op) {
+  int alen = bst_size(a);
+  int blen = bst_size(b);
+  int *sa = bst_to_sorted_array(a);
+  int *sb = bst_to_sorted_array(b);
+  int *out = malloc(sizeof(int) * (alen + blen + 1));
+  int len = merge(sa, alen, sb, blen, op, out);
+  struct bst *result = bst_create();
+  if (len > 0) slab_build(out, len, 1, result);
+  free(out);
+  free(sb);
+  free(sa);
+  return result;
+}
+
+struct bst *bst_union(struct bst *a, struct bst *b) {
+  return set_build(a, b, UNION);
+}
+
+struct bst *bst_intersection(struct bst *a, struct bst *b) {
+  return set_build(a, b, INTERSECTION);
+}
+
+struct bst *bst_difference(struct bst *a, struct bst *b) {
+  return set_build(a, b, DIFFERENCE);
+}
+
+
+// iter_push(it,node) pushes node onto the stack of it
+// effects: modifies it
 // time: O(1)
-void posto(struct bstnode *node, int* a, int* pos) {
-  if (node) {
-    posto(node->left,a,pos);
-    posto(node->right,a,pos);
-    a[*pos] = node->item;
-    (*pos)++;
+static void iter_push(struct bst_iter *it, struct bstnode *node) {
+  assert(it->top < BST_MAX_HEIGHT);
+  it->stack[it->top++] = node;
+}
+
+// iter_push_left(it,node) pushes node and it's chain of left children
+// onto the stack of it
+// effects: modifies it
+// time: O(h)
+static void iter_push_left(struct bst_iter *it, struct bstnode *node) {
+  while (node) {
+    iter_push(it, node);
+    node = node->left;
+  }
+}
+
+// iter_push_leaf(it,node) pushes the path from node down to the first
+// node in post-order among node and it's children
+// effects: modifies it
+// time: O(h)
+static void iter_push_leaf(struct bst_iter *it, struct bstnode *node) {
+  while (node) {
+    iter_push(it, node);
+    node = node->left ? node->left : node->right;
   }
 }
 
+// iter_start(it,o,node) positions it before the first item of node and
+// it's children in order o
+// requires: o is a valid order
+// effects: modifies it
+// time: O(h)
+static void iter_start(struct bst_iter *it, int o, struct bstnode *node) {
+  assert(o == PRE_ORDER || o == IN_ORDER || o == POST_ORDER);
+  it->top = 0;
+  it->order = o;
+  if (o == PRE_ORDER) {
+    if (node) iter_push(it, node);
+  } else if (o == IN_ORDER) {
+    iter_push_left(it, node);
+  } else {
+    iter_push_leaf(it, node);
+  }
+}
 
-void bst_print (int o, struct bst *t) {
-  if (t->root) {
-    int pos = 0;
-    int *result = malloc(sizeof(int) * t->root->size);
-    if ( o == PRE_ORDER ) { 
-      preo(t->root,result,&pos);
+void bst_iter_begin(struct bst_iter *it, int o, struct bst *t) {
+  iter_start(it, o, t->root);
+}
+
+void bst_iter_seek(struct bst_iter *it, int i, struct bst *t) {
+  struct bstnode *node = t->root;
+  it->top = 0;
+  it->order = IN_ORDER;
+  while (node) {
+    if (node->item >= i) {
+      iter_push(it, node);
+      node = node->left;
     } else {
-      if ( o == IN_ORDER ) {
-        ino(t->root,result,&pos);
-      } else {
-        if ( o == POST_ORDER ) {
-          posto(t->root,result,&pos);
-        }
-      }
+      node = node->right;
     }
+  }
+}
+
+bool bst_iter_next(struct bst_iter *it, int *i) {
+  if (it->top == 0) return false;
+  struct bstnode *node = it->stack[--it->top];
+  if (it->order == PRE_ORDER) {
+    if (node->right) iter_push(it, node->right);
+    if (node->left) iter_push(it, node->left);
+  } else if (it->order == IN_ORDER) {
+    iter_push_left(it, node->right);
+  } else if (it->top > 0) {
+    struct bstnode *parent = it->stack[it->top - 1];
+    if (parent->left == node) iter_push_leaf(it, parent->right);
+  }
+  *i = node->item;
+  return true;
+}
+
+void ino(struct bstnode *node, int* a, int* pos) {
+  struct bst_iter it;
+  iter_start(&it, IN_ORDER, node);
+  while (bst_iter_next(&it, &a[*pos])) {
+    (*pos)++;
+  }
+}
+
+void bst_print (int o, struct bst *t) {
+  if (t->root) {
+    struct bst_iter it;
+    int item;
+    bst_iter_begin(&it, o, t);
+    bst_iter_next(&it, &item);
     printf("[");
-    printf("%d",result[0]);
-    for(int i = 1; i < t->root->size; i++) {
-      printf(",%d",result[i]);
+    printf("%d",item);
+    while (bst_iter_next(&it, &item)) {
+      printf(",%d",item);
     }
     printf("]\n");
-    free(result);
   } else {
     printf("[empty]\n");
   }
 }
 
 
+// a frozenslot is one node of the implicit tree: the item and it's
+// position in sorted order, kept together so a search reads one line
+struct frozenslot {
+  int item;
+  int rank;
+};
 
+// eyt[k] has children eyt[2k] and eyt[2k+1]; eyt[0] is unused
+// map is the file mapping the arrays point into, or NULL if they were
+// allocated by bst_freeze
+struct bst_frozen {
+  int len;
+  int *sorted;
+  struct frozenslot *eyt;
+  void *map;
+  size_t maplen;
+  uint64_t checksum;
+};
 
+// SLOTS_PER_LINE frozenslots fill one 64 byte cache line, so the
+// descendants of eyt[k] three levels down are the line at eyt[8k]
+#define SLOTS_PER_LINE 8
 
+// eyt_fill(a,eyt,pos,k,len) stores the items of a, starting at index
+// *pos, into the subtree of eyt rooted at k in sorted order
+// effects: modifies eyt and *pos
+// time: O(n)
+static void eyt_fill(int *a, struct frozenslot *eyt, int *pos,
+                     size_t k, int len) {
+  if (k > (size_t)len) return;
+  eyt_fill(a, eyt, pos, 2 * k, len);
+  eyt[k].item = a[*pos];
+  eyt[k].rank = *pos;
+  (*pos)++;
+  eyt_fill(a, eyt, pos, 2 * k + 1, len);
+}
 
+// eyt_bytes(len) produces the size of the eyt array for len items,
+// rounded up to whole cache lines
+// time: O(1)
+static size_t eyt_bytes(int len) {
+  size_t bytes = sizeof(struct frozenslot) * ((size_t)len + 1);
+  return (bytes + 63) / 64 * 64;
+}
 
+struct bst_frozen *bst_freeze(struct bst *t) {
+  struct bst_frozen *new = malloc(sizeof(struct bst_frozen));
+  new->len = bst_size(t);
+  new->sorted = bst_to_sorted_array(t);
+  void *eyt;
+  if (posix_memalign(&eyt, 64, eyt_bytes(new->len)) != 0) eyt = NULL;
+  new->eyt = eyt;
+  new->map = NULL;
+  new->maplen = 0;
+  new->checksum = 0;
+  int pos = 0;
+  memset(new->eyt, 0, eyt_bytes(new->len));
+  eyt_fill(new->sorted, new->eyt, &pos, 1, new->len);
+  return new;
+}
 
+void bst_frozen_destroy(struct bst_frozen *f) {
+  if (f->map) {
+    munmap(f->map, f->maplen);
+  } else {
+    free(f->sorted);
+    free(f->eyt);
+  }
+  free(f);
+}
 
+int bst_frozen_size(const struct bst_frozen *f) {
+  return f->len;
+}
 
+// eyt_search(i,inclusive,f) produces the index in f->eyt of the smallest
+// item greater than i (or equal to i if not inclusive), or 0 if there is
+// no such item. The loop has no data dependent branches.
+// time: O(logn)
+static size_t eyt_search(int i, bool inclusive, const struct bst_frozen *f) {
+  const struct frozenslot *eyt = f->eyt;
+  size_t len = f->len;
+  size_t k = 1;
+  while (k <= len) {
+    __builtin_prefetch(eyt + SLOTS_PER_LINE * k);
+    k = 2 * k + (eyt[k].item < i || (inclusive && eyt[k].item == i));
+  }
+  // undo the right turns taken after the last left turn
+  k >>= __builtin_ctzl(~k) + 1;
+  return k;
+}
 
+bool bst_frozen_find(int i, const struct bst_frozen *f) {
+  size_t k = eyt_search(i, false, f);
+  return k && f->eyt[k].item == i;
+}
 
+int bst_frozen_select(int k, const struct bst_frozen *f) {
+  assert(0 <= k && k < f->len);
+  return f->sorted[k];
+}
 
+int bst_frozen_rank(int i, const struct bst_frozen *f) {
+  size_t k = eyt_search(i, false, f);
+  if (k == 0) return f->len;
+  return f->eyt[k].rank;
+}
 
+int bst_frozen_range(int start, int end, const struct bst_frozen *f) {
+  if (start > end) return 0;
+  size_t k = eyt_search(end, true, f);
+  int hi = k ? f->eyt[k].rank : f->len;
+  return hi - bst_frozen_rank(start, f);
+}
 
+// a batch search runs RANK_LANES searches side by side, so up to
+// RANK_LANES cache misses are in flight at once. Every level above the
+// last is full, so all of them take eyt_depth(len) steps and then at
+// most one more, and the loop needs no per-search exit. (Doing the
+// steps with AVX2 gathers was measured no faster than these loads: the
+// time goes to the cache misses, not the compares.)
+#define RANK_LANES 8
 
+// eyt_depth(len) produces the number of full levels of an eyt of len
+// items (len >= 1)
+// time: O(1)
+static int eyt_depth(size_t len) {
+  return 63 - __builtin_clzll(len);
+}
 
+// eyt_finish(k,f) takes the index k of a search that has left the tree
+// and produces the rank it found, as in bst_frozen_rank
+// time: O(1)
+static int eyt_finish(size_t k, const struct bst_frozen *f) {
+  k >>= __builtin_ctzl(~k) + 1;
+  return k ? f->eyt[k].rank : f->len;
+}
 
+// rank_lanes(items,ranks,f) stores the rank of each of the RANK_LANES
+// items in ranks, with the searches interleaved
+// requires: f is not empty
+// effects: modifies ranks
+// time: O(logn)
+static void rank_lanes(const int *items, int *ranks,
+                       const struct bst_frozen *f) {
+  const struct frozenslot *eyt = f->eyt;
+  size_t len = f->len;
+  size_t k[RANK_LANES];
+  for (int j = 0; j < RANK_LANES; j++) {
+    k[j] = 1;
+  }
+  for (int d = eyt_depth(len); d > 0; d--) {
+    for (int j = 0; j < RANK_LANES; j++) {
+      __builtin_prefetch(eyt + SLOTS_PER_LINE * k[j]);
+      k[j] = 2 * k[j] + (eyt[k[j]].item < items[j]);
+    }
+  }
+  for (int j = 0; j < RANK_LANES; j++) {
+    if (k[j] <= len) k[j] = 2 * k[j] + (eyt[k[j]].item < items[j]);
+    ranks[j] = eyt_finish(k[j], f);
+  }
+}
 
+void bst_frozen_rank_batch(const int *items, int n, int *ranks,
+                           const struct bst_frozen *f) {
+  int j = 0;
+  if (f->len > 0) {
+    for (; j + RANK_LANES <= n; j += RANK_LANES) {
+      rank_lanes(items + j, ranks + j, f);
+    }
+  }
+  for (; j < n; j++) {
+    ranks[j] = bst_frozen_rank(items[j], f);
+  }
+}
+
+// readers announce themselves in one of SHARED_SLOTS counters, picked
+// per thread; each counter has it's own cache line
+#define SHARED_SLOTS 64
 
+// a writer reclaims replaced nodes once RETIRE_BATCH of them are waiting
+static const int RETIRE_BATCH = 1024;
 
+// count[e] is the number of readers in this slot that started while
+// the epoch of the tree was e
+struct readerslot {
+  int count[2] __attribute__((aligned(64)));
+};
+
+// tree.root is only read and written with atomic operations; the rest
+// of tree and retired belong to the writer holding lock
+struct bst_shared {
+  struct bst tree;
+  pthread_mutex_t lock;
+  int epoch;
+  struct bstnode **retired;
+  int nretired;
+  int maxretired;
+  struct readerslot slots[SHARED_SLOTS];
+};
 
+static int next_slot = 0;
+static __thread int my_slot = -1;
+
+struct bst_shared *bst_shared_create(void) {
+  void *aligned;
+  if (posix_memalign(&aligned, 64, sizeof(struct bst_shared)) != 0) {
+    aligned = NULL;
+  }
+  struct bst_shared *new = aligned;
+  new->tree.root = NULL;
+  new->tree.slabs = NULL;
+  new->tree.free = NULL;
+  pthread_mutex_init(&new->lock, NULL);
+  new->epoch = 0;
+  new->nretired = 0;
+  new->maxretired = RETIRE_BATCH;
+  new->retired = malloc(sizeof(struct bstnode *) * new->maxretired);
+  for (int k = 0; k < SHARED_SLOTS; k++) {
+    new->slots[k].count[0] = 0;
+    new->slots[k].count[1] = 0;
+  }
+  return new;
+}
+
+void bst_shared_destroy(struct bst_shared *s) {
+  pthread_mutex_destroy(&s->lock);
+  slabs_clear(&s->tree);
+  free(s->retired);
+  free(s);
+}
+
+// read_begin(s) announces a reader of s and produces the root it may
+// use until read_end; *e is set to the epoch it was counted in
+// effects: modifies s and *e
+// time: O(1)
+static struct bstnode *read_begin(struct bst_shared *s, int *e) {
+  if (my_slot < 0) {
+    my_slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED)
+              % SHARED_SLOTS;
+  }
+  int *count = s->slots[my_slot].count;
+  while (1) {
+    *e = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&count[*e], 1, __ATOMIC_SEQ_CST);
+    // a writer may have flipped the epoch (and stopped waiting for it)
+    // before we were counted
+    if (__atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST) == *e) break;
+    __atomic_fetch_sub(&count[*e], 1, __ATOMIC_SEQ_CST);
+  }
+  return __atomic_load_n(&s->tree.root, __ATOMIC_ACQUIRE);
+}
 
+// read_end(s,e) retires a reader started by read_begin in epoch e
+// effects: modifies s
+// time: O(1)
+static void read_end(struct bst_shared *s, int e) {
+  __atomic_fetch_sub(&s->slots[my_slot].count[e], 1, __ATOMIC_RELEASE);
+}
+
+// synchronize(s) waits until no reader can still see a node retired
+// before the call, then gives the retired nodes back to the pool
+// requires: the caller holds s->lock
+// effects: modifies s
+// time: O(r), where r is the number of retired nodes, plus waiting
+static void synchronize(struct bst_shared *s) {
+  int old = s->epoch;
+  __atomic_store_n(&s->epoch, 1 - old, __ATOMIC_SEQ_CST);
+  for (int k = 0; k < SHARED_SLOTS; k++) {
+    while (__atomic_load_n(&s->slots[k].count[old], __ATOMIC_ACQUIRE)) {
+      sched_yield();
+    }
+  }
+  for (int k = 0; k < s->nretired; k++) {
+    node_free(&s->tree, s->retired[k]);
+  }
+  s->nretired = 0;
+}
+
+// node_retire(node,s) records that node is no longer reachable from
+// new readers of s
+// effects: modifies s
+// time: O(1) amortized
+static void node_retire(struct bstnode *node, struct bst_shared *s) {
+  if (s->nretired == s->maxretired) {
+    s->maxretired *= 2;
+    s->retired = realloc(s->retired,
+                         sizeof(struct bstnode *) * s->maxretired);
+  }
+  s->retired[s->nretired++] = node;
+}
+
+// node_copy(node,s) produces a private copy of node that the writer may
+// modify, and retires node
+// effects: modifies s
+// time: O(1) amortized
+static struct bstnode *node_copy(struct bstnode *node, struct bst_shared *s) {
+  struct bstnode *new = node_alloc(&s->tree);
+  *new = *node;
+  node_retire(node, s);
+  return new;
+}
+
+// shared_balance(node,s) is node_balance for a private node whose
+// children may still be visible to readers; every node that a rotation
+// modifies is copied first
+// effects: modifies node and s
+// time: O(1)
+static struct bstnode *shared_balance(struct bstnode *node,
+                                      struct bst_shared *s) {
+  int diff = node_height(node->left) - node_height(node->right);
+  if (diff > 1) {
+    node->left = node_copy(node->left, s);
+    if (node_height(node->left->left) < node_height(node->left->right)) {
+      node->left->right = node_copy(node->left->right, s);
+      node->left = rotate_left(node->left);
+    }
+    return rotate_right(node);
+  }
+  if (diff < -1) {
+    node->right = node_copy(node->right, s);
+    if (node_height(node->right->right) < node_height(node->right->left)) {
+      node->right->left = node_copy(node->right->left, s);
+      node->right = rotate_right(node->right);
+    }
+    return rotate_left(node);
+  }
+  node_update(node);
+  return node;
+}
+
+// shared_insert(i,node,s) produces a new version of node with the item i
+// inserted, sharing every unchanged subtree with node
+// requires: i is not among node and it's children
+// effects: modifies s
+// time: O(logn)
+static struct bstnode *shared_insert(int i, struct bstnode *node,
+                                     struct bst_shared *s) {
+  if (node == NULL) return node_insert(i, NULL, &s->tree);
+  node = node_copy(node, s);
+  if (i < node->item) {
+    node->left = shared_insert(i, node->left, s);
+  } else {
+    node->right = shared_insert(i, node->right, s);
+  }
+  return shared_balance(node, s);
+}
+
+// shared_remove(i,node,s) produces a new version of node with the item i
+// removed, sharing every unchanged subtree with node
+// requires: i is among node and it's children
+// effects: modifies s
+// time: O(logn)
+static struct bstnode *shared_remove(int i, struct bstnode *node,
+                                     struct bst_shared *s) {
+  if (i == node->item && (node->left == NULL || node->right == NULL)) {
+    node_retire(node, s);
+    return node->left ? node->left : node->right;
+  }
+  node = node_copy(node, s);
+  if (i < node->item) {
+    node->left = shared_remove(i, node->left, s);
+  } else if (i > node->item) {
+    node->right = shared_remove(i, node->right, s);
+  } else {
+    struct bstnode *next = node->right;
+    while (next->left) {
+      next = next->left;
+    }
+    node->item = next->item;
+    node->right = shared_remove(next->item, node->right, s);
+  }
+  return shared_balance(node, s);
+}
+
+// shared_write(s,root) publishes root as the new root of s
+// requires: the caller holds s->lock
+// effects: modifies s
+// time: O(1) amortized
+static void shared_write(struct bst_shared *s, struct bstnode *root) {
+  __atomic_store_n(&s->tree.root, root, __ATOMIC_RELEASE);
+  if (s->nretired >= RETIRE_BATCH) synchronize(s);
+}
+
+int bst_shared_size(struct bst_shared *s) {
+  int e;
+  int size = node_size(read_begin(s, &e));
+  read_end(s, e);
+  return size;
+}
+
+void bst_shared_insert(int i, struct bst_shared *s) {
+  pthread_mutex_lock(&s->lock);
+  if (!bst_find(i, &s->tree)) {
+    shared_write(s, shared_insert(i, s->tree.root, s));
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+void bst_shared_remove(int i, struct bst_shared *s) {
+  pthread_mutex_lock(&s->lock);
+  if (bst_find(i, &s->tree)) {
+    shared_write(s, shared_remove(i, s->tree.root, s));
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+bool bst_shared_find(int i, struct bst_shared *s) {
+  int e;
+  struct bstnode *node = read_begin(s, &e);
+  while (node && node->item != i) {
+    node = node->item < i ? node->right : node->left;
+  }
+  read_end(s, e);
+  return node != NULL;
+}
+
+bool bst_shared_select(int k, struct bst_shared *s, int *i) {
+  int e;
+  struct bstnode *root = read_begin(s, &e);
+  bool found = 0 <= k && k < node_size(root);
+  if (found) *i = select(k, root);
+  read_end(s, e);
+  return found;
+}
+
+int bst_shared_range(int start, int end, struct bst_shared *s) {
+  if (start > end) return 0;
+  int e;
+  struct bstnode *root = read_begin(s, &e);
+  int count = node_rank(end, true, root) - node_rank(start, false, root);
+  read_end(s, e);
+  return count;
+}
+
+
+// a bst_save file is a frozenheader, the eyt array (a whole number of
+// cache lines) and then the sorted array
+static const char FROZEN_MAGIC[8] = "BSTFROZN";
+static const uint32_t FROZEN_VERSION = 1;
+
+struct frozenheader {
+  char magic[8];
+  uint32_t version;
+  int32_t len;
+  uint64_t checksum;
+  char pad[40];
+};
+
+// checksum(data,bytes,hash) continues the 64 bit FNV-1a hash of hash
+// over the bytes at data
+// time: O(bytes)
+static uint64_t checksum(const void *data, size_t bytes, uint64_t hash) {
+  const unsigned char *p = data;
+  for (size_t k = 0; k < bytes; k++) {
+    hash = (hash ^ p[k]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// frozen_checksum(f) produces the checksum of the arrays of f
+// time: O(n)
+static uint64_t frozen_checksum(const struct bst_frozen *f) {
+  uint64_t hash = 14695981039346656037ULL;
+  hash = checksum(f->eyt, eyt_bytes(f->len), hash);
+  return checksum(f->sorted, sizeof(int) * f->len, hash);
+}
+
+bool bst_save(struct bst *t, const char *path) {
+  struct bst_frozen *f = bst_freeze(t);
+  struct frozenheader head;
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, FROZEN_MAGIC, sizeof(head.magic));
+  head.version = FROZEN_VERSION;
+  head.len = f->len;
+  head.checksum = frozen_checksum(f);
+  FILE *file = fopen(path, "wb");
+  bool ok = file != NULL;
+  if (ok) {
+    ok = fwrite(&head, sizeof(head), 1, file) == 1;
+    ok = ok && fwrite(f->eyt, eyt_bytes(f->len), 1, file) == 1;
+    if (f->len > 0) {
+      ok = ok && fwrite(f->sorted, sizeof(int) * f->len, 1, file) == 1;
+    }
+    ok = (fclose(file) == 0) && ok;
+  }
+  bst_frozen_destroy(f);
+  return ok;
+}
+
+struct bst_frozen *bst_open_mapped(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      (size_t)st.st_size >= sizeof(struct frozenheader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  const struct frozenheader *head = map;
+  size_t maplen = st.st_size;
+  if (memcmp(head->magic, FROZEN_MAGIC, sizeof(head->magic)) != 0 ||
+      head->version != FROZEN_VERSION || head->len < 0 ||
+      maplen != sizeof(struct frozenheader) + eyt_bytes(head->len) +
+                sizeof(int) * (size_t)head->len) {
+    munmap(map, maplen);
+    return NULL;
+  }
+  struct bst_frozen *new = malloc(sizeof(struct bst_frozen));
+  char *base = map;
+  new->len = head->len;
+  new->eyt = (struct frozenslot *)(base + sizeof(struct frozenheader));
+  new->sorted = (int *)(base + sizeof(struct frozenheader) +
+                        eyt_bytes(head->len));
+  new->map = map;
+  new->maplen = maplen;
+  new->checksum = head->checksum;
+  return new;
+}
+
+bool bst_frozen_verify(const struct bst_frozen *f) {
+  return f->map == NULL || frozen_checksum(f) == f->checksum;
+}
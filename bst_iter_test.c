@@ -0,0 +1,142 @@
+// Tests for the bst iterators and cursors: every walk of a random tree
+// is compared with a recursive walk of the same nodes, and range cursors
+// and bst_range_copy with a sorted copy of the items. A cursor that has
+// run past the end of it's range must leave *i (and the rest of the
+// array given to bst_range_copy) as it was.
+//
+// bst.h is the header part at the top of bst_fun.c. Build with e.g.
+//   gcc -std=c99 -O1 -g -fsanitize=address,undefined -pthread
+//       bst_fun.c bst_iter_test.c -o bst_iter_test
+// It prints "OK", or stops at a failed assert.
+
+#include "bst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define MAX_ITEMS 2000
+#define ROUNDS 300
+#define UNTOUCHED -123456
+
+// walk(node, o, a, len) stores the items of node and it's children in
+//   order o in a, starting at index *len
+// effects: modifies a and *len
+static void walk(struct bstnode *node, int o, int *a, int *len) {
+  if (node == NULL) return;
+  if (o == PRE_ORDER) a[(*len)++] = node->item;
+  walk(node->left, o, a, len);
+  if (o == IN_ORDER) a[(*len)++] = node->item;
+  walk(node->right, o, a, len);
+  if (o == POST_ORDER) a[(*len)++] = node->item;
+}
+
+// test_iter(t) checks every order of bst_iter_begin and bst_iter_seek
+//   against walk
+static void test_iter(struct bst *t) {
+  static int expected[MAX_ITEMS];
+  const int orders[] = {PRE_ORDER, IN_ORDER, POST_ORDER};
+  for (int k = 0; k < 3; k++) {
+    int len = 0;
+    walk(t->root, orders[k], expected, &len);
+    assert(len == bst_size(t));
+    struct bst_iter it;
+    bst_iter_begin(&it, orders[k], t);
+    int i = UNTOUCHED;
+    for (int pos = 0; pos < len; pos++) {
+      assert(bst_iter_next(&it, &i));
+      assert(i == expected[pos]);
+    }
+    assert(!bst_iter_next(&it, &i));
+    assert(len == 0 ? i == UNTOUCHED : i == expected[len - 1]);
+  }
+  int len = 0;
+  walk(t->root, IN_ORDER, expected, &len);
+  for (int start = -2; start <= 2 * MAX_ITEMS + 2; start += 37) {
+    struct bst_iter it;
+    bst_iter_seek(&it, start, t);
+    int pos = 0;
+    while (pos < len && expected[pos] < start) {
+      pos++;
+    }
+    int i;
+    while (bst_iter_next(&it, &i)) {
+      assert(pos < len && i == expected[pos++]);
+    }
+    assert(pos == len);
+  }
+}
+
+// test_cursor(t) checks bst_cursor_next and bst_range_copy on ranges of
+//   t against a sorted copy of it's items
+static void test_cursor(struct bst *t) {
+  static int sorted[MAX_ITEMS];
+  static int copy[MAX_ITEMS + 1];
+  int len = 0;
+  walk(t->root, IN_ORDER, sorted, &len);
+  for (int round = 0; round < 50; round++) {
+    int start = rand() % (2 * MAX_ITEMS + 4) - 2;
+    int end = start + rand() % (round % 2 ? 20 : 2 * MAX_ITEMS);
+    int first = 0;
+    while (first < len && sorted[first] < start) {
+      first++;
+    }
+    int last = first;
+    while (last < len && sorted[last] <= end) {
+      last++;
+    }
+    struct bst_cursor c;
+    bst_cursor_range(&c, start, end, t);
+    int i = UNTOUCHED;
+    for (int pos = first; pos < last; pos++) {
+      assert(bst_cursor_next(&c, &i));
+      assert(i == sorted[pos]);
+    }
+    // past the end, *i keeps the last item (or it's first value)
+    assert(!bst_cursor_next(&c, &i));
+    assert(i == (last > first ? sorted[last - 1] : UNTOUCHED));
+    assert(!bst_cursor_next(&c, &i));
+    assert(i == (last > first ? sorted[last - 1] : UNTOUCHED));
+    // room for one more item than the range has: the extra slot must
+    // not be written
+    int room = last - first + 1 < MAX_ITEMS ? last - first + 1 : MAX_ITEMS;
+    for (int k = 0; k <= room; k++) {
+      copy[k] = UNTOUCHED;
+    }
+    int n = bst_range_copy(start, end, t, copy, room);
+    assert(n == (last - first < room ? last - first : room));
+    for (int k = 0; k < n; k++) {
+      assert(copy[k] == sorted[first + k]);
+    }
+    for (int k = n; k <= room; k++) {
+      assert(copy[k] == UNTOUCHED);
+    }
+  }
+}
+
+int main(void) {
+  // {1..5}, range 1..3 into room for 6: a[3] must not be written
+  struct bst *t = bst_create();
+  for (int i = 1; i <= 5; i++) {
+    bst_insert(i, t);
+  }
+  int a[6] = {0, 0, 0, 0, 0, 0};
+  assert(bst_range_copy(1, 3, t, a, 6) == 3);
+  assert(a[0] == 1 && a[1] == 2 && a[2] == 3 && a[3] == 0);
+  bst_destroy(t);
+  srand(6);
+  for (int round = 0; round < ROUNDS; round++) {
+    t = bst_create();
+    int n = rand() % (round % 10 ? 200 : MAX_ITEMS);
+    for (int k = 0; k < n; k++) {
+      bst_insert(rand() % (2 * MAX_ITEMS), t);
+    }
+    for (int k = rand() % (n + 1); k > 0; k--) {
+      bst_remove(rand() % (2 * MAX_ITEMS), t);
+    }
+    test_iter(t);
+    test_cursor(t);
+    bst_destroy(t);
+  }
+  puts("OK");
+}
@@ -0,0 +1,149 @@
+// Throughput of bst_shared against a bst behind a pthread_rwlock, for
+// 1, 2, 4, ... reader threads while one writer keeps inserting and
+// removing keys. Each run lasts SECONDS and reports the total finds per
+// second of the readers and the writes per second of the writer.
+//
+// bst.h is the header part at the top of bst_fun.c. Build with e.g.
+//   gcc -std=c99 -O2 -pthread bst_fun.c bst_shared_bench.c
+//       -o bst_shared_bench
+//   ./bst_shared_bench [max readers]                 (default 8)
+// Reader scaling can only show on a machine with that many free cores.
+
+#include "bst.h"
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#define KEYS (1 << 20)
+#define SECONDS 0.5
+#define MAX_THREADS 64
+
+// a run reads and writes either shared or locked (under lock)
+struct run {
+  struct bst_shared *shared;
+  struct bst *locked;
+  pthread_rwlock_t lock;
+  int stop;
+};
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r >> 8;
+}
+
+struct worker {
+  pthread_t thread;
+  struct run *run;
+  unsigned seed;
+  long ops;
+};
+
+// reader(arg) finds random keys until the run stops
+static void *reader(void *arg) {
+  struct worker *w = arg;
+  struct run *run = w->run;
+  long found = 0;
+  while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+    for (int n = 0; n < 256; n++) {
+      int k = next_random(&w->seed) % KEYS;
+      if (run->shared) {
+        found += bst_shared_find(k, run->shared);
+      } else {
+        pthread_rwlock_rdlock(&run->lock);
+        found += bst_find(k, run->locked);
+        pthread_rwlock_unlock(&run->lock);
+      }
+    }
+    w->ops += 256;
+  }
+  return (void *)found;
+}
+
+// writer(arg) inserts and removes random keys until the run stops
+static void *writer(void *arg) {
+  struct worker *w = arg;
+  struct run *run = w->run;
+  while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+    int k = next_random(&w->seed) % KEYS;
+    bool insert = next_random(&w->seed) % 2;
+    if (run->shared) {
+      if (insert) {
+        bst_shared_insert(k, run->shared);
+      } else {
+        bst_shared_remove(k, run->shared);
+      }
+    } else {
+      pthread_rwlock_wrlock(&run->lock);
+      if (insert) {
+        bst_insert(k, run->locked);
+      } else {
+        bst_remove(k, run->locked);
+      }
+      pthread_rwlock_unlock(&run->lock);
+    }
+    w->ops++;
+  }
+  return NULL;
+}
+
+// measure(run, readers) runs readers reader threads and one writer on
+//   run for SECONDS and prints their throughput
+static void measure(struct run *run, int readers) {
+  struct worker w[MAX_THREADS + 1];
+  run->stop = 0;
+  double start = now();
+  for (int i = 0; i <= readers; i++) {
+    w[i].run = run;
+    w[i].seed = i * 7919 + 1;
+    w[i].ops = 0;
+    pthread_create(&w[i].thread, NULL, i < readers ? reader : writer, &w[i]);
+  }
+  while (now() - start < SECONDS) {
+    struct timespec ts = {0, 10000000};
+    nanosleep(&ts, NULL);
+  }
+  __atomic_store_n(&run->stop, 1, __ATOMIC_RELAXED);
+  long reads = 0;
+  for (int i = 0; i <= readers; i++) {
+    pthread_join(w[i].thread, NULL);
+    if (i < readers) reads += w[i].ops;
+  }
+  double elapsed = now() - start;
+  printf("%-8s %7d %12.2f %12.2f\n", run->shared ? "shared" : "rwlock",
+         readers, reads / elapsed / 1e6, w[readers].ops / elapsed / 1e6);
+}
+
+int main(int argc, char **argv) {
+  int max = argc > 1 ? atoi(argv[1]) : 8;
+  if (max < 1) max = 1;
+  if (max > MAX_THREADS) max = MAX_THREADS;
+  struct run shared = {.shared = bst_shared_create()};
+  struct run locked = {.locked = bst_create()};
+  pthread_rwlock_init(&locked.lock, NULL);
+  unsigned seed = 12345;
+  for (int n = 0; n < KEYS / 2; n++) {
+    int k = next_random(&seed) % KEYS;
+    bst_shared_insert(k, shared.shared);
+    bst_insert(k, locked.locked);
+  }
+  printf("%-8s %7s %12s %12s\n", "tree", "readers", "Mfinds/s", "Mwrites/s");
+  for (int readers = 1; readers <= max; readers *= 2) {
+    measure(&shared, readers);
+    measure(&locked, readers);
+  }
+  pthread_rwlock_destroy(&locked.lock);
+  bst_destroy(locked.locked);
+  bst_shared_destroy(shared.shared);
+}
@@ -0,0 +1,135 @@
+// Stress test for bst_shared: reader threads search the tree without
+// locks while writer threads insert and remove keys, and every result a
+// reader sees must be possible for some version of the tree.
+//
+// bst.h is the header part at the top of bst_fun.c. Build with
+// ThreadSanitizer to also catch data races, e.g.
+//   gcc -std=c99 -O1 -g -fsanitize=thread -pthread bst_fun.c
+//       bst_shared_test.c -o bst_shared_test
+//   ./bst_shared_test [readers] [writers]     (default 4 readers, 2 writers)
+// It prints "OK" and the number of reads, or stops at a failed assert.
+
+#include "bst.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+// keys are 0 ... KEYS - 1; the even keys below PINNED are inserted
+// before the threads start and never removed, the others are changed by
+// the writers (key k only by writer k % writers, so the final tree is
+// known)
+#define KEYS 4096
+#define PINNED 128
+#define WRITES 200000
+#define MAX_THREADS 64
+
+static struct bst_shared *tree;
+static int writers;
+static int stop = 0;
+
+struct writer {
+  pthread_t thread;
+  int id;
+  bool present[KEYS];
+};
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r >> 8;
+}
+
+// reader(arg) checks the results of finds, selects and ranges until stop
+//   is set, and produces the number of rounds it made
+static void *reader(void *arg) {
+  unsigned r = (unsigned)(long)arg;
+  long rounds = 0;
+  while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+    int k = next_random(&r) % KEYS;
+    bst_shared_find(k, tree);
+    assert(bst_shared_find((k % PINNED) & ~1, tree));
+    int i = -1;
+    int size = bst_shared_size(tree);
+    if (size > 0 && bst_shared_select(k % size, tree, &i)) {
+      assert(0 <= i && i < KEYS);
+      assert(i >= PINNED || i % 2 == 0);
+    }
+    assert(bst_shared_range(0, PINNED - 1, tree) == PINNED / 2);
+    int count = bst_shared_range(0, KEYS - 1, tree);
+    assert(PINNED / 2 <= count && count <= KEYS);
+    rounds++;
+  }
+  return (void *)rounds;
+}
+
+// writer(arg) makes WRITES random inserts and removes of it's own keys,
+//   recording which of them are left in the tree
+static void *writer(void *arg) {
+  struct writer *w = arg;
+  unsigned r = w->id * 7919 + 1;
+  for (int n = 0; n < WRITES; n++) {
+    int k = next_random(&r) % KEYS;
+    if (k < PINNED || k % writers != w->id) continue;
+    if (next_random(&r) % 2) {
+      bst_shared_insert(k, tree);
+      w->present[k] = true;
+    } else {
+      bst_shared_remove(k, tree);
+      w->present[k] = false;
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  int readers = argc > 1 ? atoi(argv[1]) : 4;
+  writers = argc > 2 ? atoi(argv[2]) : 2;
+  assert(1 <= readers && readers <= MAX_THREADS);
+  assert(1 <= writers && writers <= MAX_THREADS);
+  tree = bst_shared_create();
+  for (int k = 0; k < PINNED; k += 2) {
+    bst_shared_insert(k, tree);
+  }
+  pthread_t rthreads[MAX_THREADS];
+  struct writer *w = calloc(writers, sizeof(struct writer));
+  for (long i = 0; i < readers; i++) {
+    pthread_create(&rthreads[i], NULL, reader, (void *)(i + 1));
+  }
+  for (int i = 0; i < writers; i++) {
+    w[i].id = i;
+    pthread_create(&w[i].thread, NULL, writer, &w[i]);
+  }
+  for (int i = 0; i < writers; i++) {
+    pthread_join(w[i].thread, NULL);
+  }
+  __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+  long reads = 0;
+  for (int i = 0; i < readers; i++) {
+    void *rounds;
+    pthread_join(rthreads[i], &rounds);
+    reads += (long)rounds;
+  }
+  // the final tree holds exactly the pinned keys and the keys each
+  // writer inserted last
+  int expected = 0;
+  for (int k = 0; k < KEYS; k++) {
+    bool present = k < PINNED ? k % 2 == 0 : w[k % writers].present[k];
+    assert(bst_shared_find(k, tree) == present);
+    expected += present;
+  }
+  assert(bst_shared_size(tree) == expected);
+  assert(bst_shared_range(0, KEYS - 1, tree) == expected);
+  int prev = -1;
+  for (int k = 0; k < expected; k++) {
+    int i;
+    assert(bst_shared_select(k, tree, &i));
+    assert(i > prev);
+    prev = i;
+  }
+  free(w);
+  bst_shared_destroy(tree);
+  printf("OK %ld reads\n", reads);
+}
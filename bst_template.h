@@ -0,0 +1,282 @@
+#ifndef BST_TEMPLATE_H
+#define BST_TEMPLATE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+// bst_template.h
+// BST_DEFINE(name, key_t, val_t, less) defines a key/value version of the
+// bst module for any key and value type. Every function is generated for
+// the types given, so keys and values are stored inline in the nodes and
+// less is expanded in place (no function pointer calls).
+//
+//   name  : prefix of the generated struct and functions
+//   key_t : type of the keys (e.g. long long)
+//   val_t : type of the values stored with each key
+//   less  : less(a, b) determines if key a comes before key b; it may be
+//           a macro or an (inline) function
+//
+// example:
+//   #define LL_LESS(a, b) ((a) < (b))
+//   BST_DEFINE(llmap, long long, double, LL_LESS)
+//   struct llmap *m = llmap_create();
+//   llmap_insert(42, 1.5, m);
+//   double *v = llmap_find(42, m);       // v points at 1.5
+//   llmap_destroy(m);
+//
+// Like struct bst, the tree is kept AVL balanced and every node stores
+// the size of it's subtree. The generated functions are:
+//
+// struct name *name_create(void)
+//   returns a new (empty) tree
+//   effects: allocates memory (caller must call name_destroy)
+//   time: O(1)
+//
+// void name_destroy(struct name *t)
+//   effects: the memory at t is invalid (freed)
+//   time: O(n)
+//
+// int name_size(struct name *t)
+//   returns the number of keys in t
+//   time: O(1)
+//
+// void name_insert(key_t k, val_t v, struct name *t)
+//   inserts the key k with value v into t, or replaces the value of k
+//   if it is already in t
+//   effects: modifies t
+//   time: O(logn)
+//
+// val_t *name_find(key_t k, struct name *t)
+//   returns a pointer to the value of k, or NULL if k is not in t
+//   note: the pointer is invalid once k is removed from t (inserting
+//         and removing other keys does not move the value of k)
+//   time: O(logn)
+//
+// key_t name_select(int k, struct name *t, val_t **v)
+//   returns the k'th key from t in sorted order, and stores a pointer
+//   to it's value in *v if v is not NULL
+//   requires: 0 <= k < name_size(t)
+//   time: O(logn)
+//
+// void name_remove(key_t k, struct name *t)
+//   removes k and it's value from t if it exists
+//   effects: modifies t if k is in t
+//   time: O(logn)
+//
+// int name_range(key_t start, key_t end, struct name *t)
+//   returns the number of keys in t that are between start and end
+//   (inclusive)
+//   time: O(logn)
+
+#define BST_DEFINE(name, key_t, val_t, less)                              \
+                                                                          \
+struct name##_node {                                                      \
+  key_t key;                                                              \
+  val_t value;                                                            \
+  struct name##_node *left;                                               \
+  struct name##_node *right;                                              \
+  int size;                                                               \
+  int height;                                                             \
+};                                                                        \
+                                                                          \
+struct name {                                                             \
+  struct name##_node *root;                                               \
+};                                                                        \
+                                                                          \
+static inline struct name *name##_create(void) {                          \
+  struct name *new = malloc(sizeof(struct name));                         \
+  new->root = NULL;                                                       \
+  return new;                                                             \
+}                                                                         \
+                                                                          \
+static inline void name##_node_destroy(struct name##_node *node) {        \
+  if (node) {                                                             \
+    name##_node_destroy(node->left);                                      \
+    name##_node_destroy(node->right);                                     \
+    free(node);                                                           \
+  }                                                                       \
+}                                                                         \
+                                                                          \
+static inline void name##_destroy(struct name *t) {                       \
+  name##_node_destroy(t->root);                                           \
+  free(t);                                                                \
+}                                                                         \
+                                                                          \
+static inline int name##_node_size(struct name##_node *node) {            \
+  return node ? node->size : 0;                                           \
+}                                                                         \
+                                                                          \
+static inline int name##_size(struct name *t) {                           \
+  return name##_node_size(t->root);                                       \
+}                                                                         \
+                                                                          \
+static inline int name##_node_height(struct name##_node *node) {          \
+  return node ? node->height : 0;                                         \
+}                                                                         \
+                                                                          \
+static inline void name##_node_update(struct name##_node *node) {         \
+  int lh = name##_node_height(node->left);                                \
+  int rh = name##_node_height(node->right);                               \
+  node->size = name##_node_size(node->left) +                             \
+               name##_node_size(node->right) + 1;                         \
+  node->height = (lh > rh ? lh : rh) + 1;                                 \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_rotate_right(                    \
+    struct name##_node *node) {                                           \
+  struct name##_node *top = node->left;                                   \
+  node->left = top->right;                                                \
+  top->right = node;                                                      \
+  name##_node_update(node);                                               \
+  name##_node_update(top);                                                \
+  return top;                                                             \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_rotate_left(                     \
+    struct name##_node *node) {                                           \
+  struct name##_node *top = node->right;                                  \
+  node->right = top->left;                                                \
+  top->left = node;                                                       \
+  name##_node_update(node);                                               \
+  name##_node_update(top);                                                \
+  return top;                                                             \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_node_balance(                    \
+    struct name##_node *node) {                                           \
+  int diff = name##_node_height(node->left) -                             \
+             name##_node_height(node->right);                             \
+  if (diff > 1) {                                                         \
+    if (name##_node_height(node->left->left) <                            \
+        name##_node_height(node->left->right)) {                          \
+      node->left = name##_rotate_left(node->left);                        \
+    }                                                                     \
+    return name##_rotate_right(node);                                     \
+  }                                                                       \
+  if (diff < -1) {                                                        \
+    if (name##_node_height(node->right->right) <                          \
+        name##_node_height(node->right->left)) {                          \
+      node->right = name##_rotate_right(node->right);                     \
+    }                                                                     \
+    return name##_rotate_left(node);                                      \
+  }                                                                       \
+  name##_node_update(node);                                               \
+  return node;                                                            \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_node_insert(                     \
+    key_t k, val_t v, struct name##_node *node) {                         \
+  if (node == NULL) {                                                     \
+    struct name##_node *new = malloc(sizeof(struct name##_node));         \
+    new->key = k;                                                         \
+    new->value = v;                                                       \
+    new->left = NULL;                                                     \
+    new->right = NULL;                                                    \
+    new->size = 1;                                                        \
+    new->height = 1;                                                      \
+    return new;                                                           \
+  }                                                                       \
+  if (less(k, node->key)) {                                               \
+    node->left = name##_node_insert(k, v, node->left);                    \
+  } else if (less(node->key, k)) {                                        \
+    node->right = name##_node_insert(k, v, node->right);                  \
+  } else {                                                                \
+    node->value = v;                                                      \
+    return node;                                                          \
+  }                                                                       \
+  return name##_node_balance(node);                                       \
+}                                                                         \
+                                                                          \
+static inline void name##_insert(key_t k, val_t v, struct name *t) {      \
+  t->root = name##_node_insert(k, v, t->root);                            \
+}                                                                         \
+                                                                          \
+static inline val_t *name##_find(key_t k, struct name *t) {               \
+  struct name##_node *node = t->root;                                     \
+  while (node) {                                                          \
+    if (less(k, node->key)) {                                             \
+      node = node->left;                                                  \
+    } else if (less(node->key, k)) {                                      \
+      node = node->right;                                                 \
+    } else {                                                              \
+      return &node->value;                                                \
+    }                                                                     \
+  }                                                                       \
+  return NULL;                                                            \
+}                                                                         \
+                                                                          \
+static inline key_t name##_select(int k, struct name *t, val_t **v) {     \
+  assert(0 <= k && k < name##_size(t));                                   \
+  struct name##_node *node = t->root;                                     \
+  while (1) {                                                             \
+    int lsize = name##_node_size(node->left);                             \
+    if (k == lsize) break;                                                \
+    if (k < lsize) {                                                      \
+      node = node->left;                                                  \
+    } else {                                                              \
+      k -= lsize + 1;                                                     \
+      node = node->right;                                                 \
+    }                                                                     \
+  }                                                                       \
+  if (v) *v = &node->value;                                               \
+  return node->key;                                                       \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_node_remove_min(                 \
+    struct name##_node *node, struct name##_node **min) {                 \
+  if (node->left == NULL) {                                               \
+    *min = node;                                                          \
+    return node->right;                                                   \
+  }                                                                       \
+  node->left = name##_node_remove_min(node->left, min);                   \
+  return name##_node_balance(node);                                       \
+}                                                                         \
+                                                                          \
+static inline struct name##_node *name##_node_remove(                     \
+    key_t k, struct name##_node *node) {                                  \
+  if (node == NULL) return NULL;                                          \
+  if (less(k, node->key)) {                                               \
+    node->left = name##_node_remove(k, node->left);                       \
+  } else if (less(node->key, k)) {                                        \
+    node->right = name##_node_remove(k, node->right);                     \
+  } else {                                                                \
+    if (node->left == NULL || node->right == NULL) {                      \
+      struct name##_node *child = node->left ? node->left : node->right;  \
+      free(node);                                                         \
+      return child;                                                       \
+    }                                                                     \
+    struct name##_node *next;                                             \
+    struct name##_node *right =                                           \
+        name##_node_remove_min(node->right, &next);                       \
+    next->left = node->left;                                              \
+    next->right = right;                                                  \
+    free(node);                                                           \
+    node = next;                                                          \
+  }                                                                       \
+  return name##_node_balance(node);                                       \
+}                                                                         \
+                                                                          \
+static inline void name##_remove(key_t k, struct name *t) {               \
+  t->root = name##_node_remove(k, t->root);                               \
+}                                                                         \
+                                                                          \
+static inline int name##_rank(key_t k, bool inclusive, struct name *t) {  \
+  struct name##_node *node = t->root;                                     \
+  int rank = 0;                                                           \
+  while (node) {                                                          \
+    if (less(node->key, k) || (inclusive && !less(k, node->key))) {       \
+      rank += name##_node_size(node->left) + 1;                           \
+      node = node->right;                                                 \
+    } else {                                                              \
+      node = node->left;                                                  \
+    }                                                                     \
+  }                                                                       \
+  return rank;                                                            \
+}                                                                         \
+                                                                          \
+static inline int name##_range(key_t start, key_t end, struct name *t) {  \
+  if (less(end, start)) return 0;                                         \
+  return name##_rank(end, true, t) - name##_rank(start, false, t);        \
+}
+
+#endif
@@ -0,0 +1,108 @@
+// Tests for BST_DEFINE: a generated map is compared with a plain array
+// on random inserts and removes, it's AVL invariants are checked, and a
+// value pointer returned by find must stay valid (and keep pointing at
+// the value of it's key) while other keys are inserted and removed.
+//
+// Build with e.g.
+//   gcc -std=c99 -O1 -g -fsanitize=address,undefined
+//       bst_template_test.c -o bst_template_test
+// It prints "OK", or stops at a failed assert.
+
+#include "bst_template.h"
+#include "bst_template.h"   // a second include must be harmless
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define INT_LESS(a, b) ((a) < (b))
+BST_DEFINE(imap, int, int, INT_LESS)
+
+#define KEYS 1000
+#define ROUNDS 200000
+
+// check(node, lo, hi) checks that the keys of node and it's children are
+//   between lo and hi and that their sizes, heights and balance are
+//   right, and produces the height of node
+static int check(struct imap_node *node, int lo, int hi) {
+  if (node == NULL) return 0;
+  assert(lo <= node->key && node->key <= hi);
+  int left = check(node->left, lo, node->key - 1);
+  int right = check(node->right, node->key + 1, hi);
+  assert(left - right <= 1 && right - left <= 1);
+  assert(node->size == imap_node_size(node->left) +
+                       imap_node_size(node->right) + 1);
+  int height = (left > right ? left : right) + 1;
+  assert(node->height == height);
+  return height;
+}
+
+// test_successor() removes a key with two children whose successor has a
+//   value pointer, as in keys 1..7: removing 4 must not move 5's value
+static void test_successor(void) {
+  struct imap *m = imap_create();
+  for (int k = 1; k <= 7; k++) {
+    imap_insert(k, k * 10, m);
+  }
+  int *five = imap_find(5, m);
+  int *six = imap_find(6, m);
+  imap_remove(4, m);
+  assert(imap_find(5, m) == five && *five == 50);
+  imap_remove(5, m);
+  assert(imap_find(6, m) == six && *six == 60);
+  assert(imap_size(m) == 5);
+  check(m->root, 1, 7);
+  imap_destroy(m);
+}
+
+// test_random() runs ROUNDS random inserts and removes against an array,
+//   keeping a value pointer for every key that is in the map
+static void test_random(void) {
+  static bool in[KEYS];
+  static int value[KEYS];
+  static int *ptr[KEYS];
+  struct imap *m = imap_create();
+  srand(12);
+  for (int round = 0; round < ROUNDS; round++) {
+    int k = rand() % KEYS;
+    if (rand() % 2) {
+      value[k] = rand();
+      imap_insert(k, value[k], m);
+      // replacing the value of a key keeps it where it was
+      assert(!in[k] || imap_find(k, m) == ptr[k]);
+      in[k] = true;
+      ptr[k] = imap_find(k, m);
+    } else {
+      imap_remove(k, m);
+      in[k] = false;
+      ptr[k] = NULL;
+      assert(imap_find(k, m) == NULL);
+    }
+    int j = rand() % KEYS;
+    if (in[j]) assert(imap_find(j, m) == ptr[j] && *ptr[j] == value[j]);
+    if (round % 1000 == 0) check(m->root, 0, KEYS - 1);
+  }
+  int rank = 0;
+  for (int k = 0; k < KEYS; k++) {
+    if (!in[k]) continue;
+    int *v;
+    assert(imap_select(rank++, m, &v) == k);
+    assert(v == ptr[k] && *v == value[k]);
+  }
+  assert(rank == imap_size(m));
+  for (int start = -3; start < KEYS; start += 17) {
+    int end = start + rand() % 100;
+    int count = 0;
+    for (int k = start < 0 ? 0 : start; k <= end && k < KEYS; k++) {
+      count += in[k];
+    }
+    assert(imap_range(start, end, m) == count);
+  }
+  imap_destroy(m);
+}
+
+int main(void) {
+  test_successor();
+  test_random();
+  puts("OK");
+}
@@ -0,0 +1,465 @@
+#include <stdbool.h>
+#include <stdint.h>
+# cbst.h
+// A compact version of the bst module: all of the nodes of a tree live
+// in one growable array and refer to their children by 32-bit index, so
+// a node takes 16 bytes and there is no per-node malloc.
+// The tree is kept weight balanced (no subtree is more than 3 times as
+// heavy as it's sibling), which needs only the size of each node.
+
+// NOTES: All of the following functions REQUIRE:
+//        pointers to a cbst (e.g., t) are valid (not NULL)
+//
+//       For times, n is the size of the tree
+//       The orders (PRE_ORDER, ...) are the ones from bst.h
+
+// index 0 is the empty tree, so child indices start at 1
+struct cbstnode {
+  int item;
+  uint32_t left;
+  uint32_t right;
+  uint32_t size;
+};
+
+struct cbst {
+  struct cbstnode *nodes;
+  uint32_t len;        // nodes in use, including index 0
+  uint32_t maxlen;
+  uint32_t root;
+  uint32_t free;       // removed nodes, linked through left
+};
+
+// cbst_create() returns a pointer to a new (empty) cbst
+// effects: allocates memory (caller must call cbst_destroy)
+// time: O(1)
+struct cbst *cbst_create(void);
+
+// cbst_destroy(t) frees all dynamically allocated memory
+// effects: the memory at t is invalid (freed)
+// time: O(1)
+void cbst_destroy(struct cbst *t);
+
+// cbst_size(t) returns the number of nodes in the cbst
+// time: O(1)
+int cbst_size(struct cbst *t);
+
+// cbst_insert(i, t) inserts the item i into the cbst t
+// effects: modifies t if i is not already in t
+// time: O(logn) amortized (the node array sometimes grows)
+void cbst_insert(int i, struct cbst *t);
+
+// cbst_find(i, t) determines if i is in t
+// time: O(logn)
+bool cbst_find(int i, struct cbst *t);
+
+// cbst_select(k, t) returns the k'th element from t in sorted order
+// requires: 0 <= k < cbst_size(t)
+// time: O(logn)
+int cbst_select(int k, struct cbst *t);
+
+// cbst_remove(i, t) removes i from cbst t if it exists
+// effects: modifies t if i is in t
+// time: O(logn)
+void cbst_remove(int i, struct cbst *t);
+
+// cbst_range(start, end, t) returns the number of items in t that are
+//   between the values of start and end (inclusive)
+// time: O(logn)
+int cbst_range(int start, int end, struct cbst *t);
+
+// cbst_print(o, t) prints the cbst to the screen in order o, in the
+//   same format as bst_print
+// requires: o is a valid order
+// effects: displays output
+// time: O(n)
+void cbst_print(int o, struct cbst *t);
+
+// cbst_to_sorted_array(t) returns a pointer to a new array
+//   which contains all of the items from t in sorted order
+//   returns NULL if t is empty
+// effects : allocates memory (caller must free)
+// time: O(n)
+int *cbst_to_sorted_array(struct cbst *t);
+
+// sorted_array_to_cbst(a, len) creates a new balanced cbst that
+//   contains all of the items from a
+// requires: a is sorted in ascending order, len >= 1,
+//           a contains no duplicates
+// effects: allocates memory (caller must call cbst_destroy)
+// time: O(n)
+struct cbst *sorted_array_to_cbst(int *a, int len);
+
+
+
+#include "cbst.h"
+#include "bst.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+// a node is out of balance when one child weighs more than DELTA times
+// the other; a single rotation fixes it unless the inner grandchild
+// weighs at least RATIO times the outer one (Hirai and Yamamoto)
+static const uint32_t DELTA = 3;
+static const uint32_t RATIO = 2;
+
+struct cbst *cbst_create(void) {
+  struct cbst *new = malloc(sizeof(struct cbst));
+  new->maxlen = 16;
+  new->nodes = malloc(sizeof(struct cbstnode) * new->maxlen);
+  new->nodes[0].item = 0;
+  new->nodes[0].left = 0;
+  new->nodes[0].right = 0;
+  new->nodes[0].size = 0;
+  new->len = 1;
+  new->root = 0;
+  new->free = 0;
+  return new;
+}
+
+void cbst_destroy(struct cbst *t) {
+  free(t->nodes);
+  free(t);
+}
+
+int cbst_size(struct cbst *t) {
+  return t->nodes[t->root].size;
+}
+
+// node_alloc(t) produces the index of an unused node of t, reusing a
+// removed node if there is one
+// effects: may grow (and so move) t->nodes
+// time: O(1) amortized
+static uint32_t node_alloc(struct cbst *t) {
+  if (t->free) {
+    uint32_t node = t->free;
+    t->free = t->nodes[node].left;
+    return node;
+  }
+  if (t->len == t->maxlen) {
+    assert(t->maxlen <= UINT32_MAX / 2);
+    t->maxlen *= 2;
+    t->nodes = realloc(t->nodes, sizeof(struct cbstnode) * t->maxlen);
+  }
+  return t->len++;
+}
+
+// node_free(node,t) gives node back to t to be reused by node_alloc
+// effects: modifies t
+// time: O(1)
+static void node_free(uint32_t node, struct cbst *t) {
+  t->nodes[node].left = t->free;
+  t->free = node;
+}
+
+// node_update(node,t) recomputes the size of node from it's children
+// effects: modifies t
+// time: O(1)
+static void node_update(uint32_t node, struct cbst *t) {
+  struct cbstnode *n = &t->nodes[node];
+  n->size = t->nodes[n->left].size + t->nodes[n->right].size + 1;
+}
+
+// rotate_right(node,t) lifts the left child of node into it's place and
+// produces the new root of the subtree
+// requires: node has a left child
+// effects: modifies t
+// time: O(1)
+static uint32_t rotate_right(uint32_t node, struct cbst *t) {
+  uint32_t top = t->nodes[node].left;
+  t->nodes[node].left = t->nodes[top].right;
+  t->nodes[top].right = node;
+  node_update(node, t);
+  node_update(top, t);
+  return top;
+}
+
+// rotate_left(node,t) lifts the right child of node into it's place and
+// produces the new root of the subtree
+// requires: node has a right child
+// effects: modifies t
+// time: O(1)
+static uint32_t rotate_left(uint32_t node, struct cbst *t) {
+  uint32_t top = t->nodes[node].right;
+  t->nodes[node].right = t->nodes[top].left;
+  t->nodes[top].left = node;
+  node_update(node, t);
+  node_update(top, t);
+  return top;
+}
+
+// weight(node,t) produces the weight (size + 1) of node
+// time: O(1)
+static uint32_t weight(uint32_t node, struct cbst *t) {
+  return t->nodes[node].size + 1;
+}
+
+// node_balance(node,t) updates node and restores the weight balance at
+// node, then produces the new root of the subtree
+// requires: node was balanced before one item was inserted into or
+//           removed from one of it's children
+// effects: modifies t
+// time: O(1)
+static uint32_t node_balance(uint32_t node, struct cbst *t) {
+  uint32_t left = t->nodes[node].left;
+  uint32_t right = t->nodes[node].right;
+  if (DELTA * weight(left, t) < weight(right, t)) {
+    if (weight(t->nodes[right].left, t) >=
+        RATIO * weight(t->nodes[right].right, t)) {
+      t->nodes[node].right = rotate_right(right, t);
+    }
+    return rotate_left(node, t);
+  }
+  if (DELTA * weight(right, t) < weight(left, t)) {
+    if (weight(t->nodes[left].right, t) >=
+        RATIO * weight(t->nodes[left].left, t)) {
+      t->nodes[node].left = rotate_left(left, t);
+    }
+    return rotate_right(node, t);
+  }
+  node_update(node, t);
+  return node;
+}
+
+// node_insert(i,node,t) inserts the item i among node and it's children
+// and produces the new root of the subtree
+// effects: modifies t if i is not already in it
+// time: O(logn) amortized
+static uint32_t node_insert(int i, uint32_t node, struct cbst *t) {
+  if (node == 0) {
+    uint32_t new = node_alloc(t);
+    t->nodes[new].item = i;
+    t->nodes[new].left = 0;
+    t->nodes[new].right = 0;
+    t->nodes[new].size = 1;
+    return new;
+  }
+  if (i < t->nodes[node].item) {
+    uint32_t left = node_insert(i, t->nodes[node].left, t);
+    t->nodes[node].left = left;
+  } else if (i > t->nodes[node].item) {
+    uint32_t right = node_insert(i, t->nodes[node].right, t);
+    t->nodes[node].right = right;
+  } else {
+    return node;
+  }
+  return node_balance(node, t);
+}
+
+void cbst_insert(int i, struct cbst *t) {
+  t->root = node_insert(i, t->root, t);
+}
+
+bool cbst_find(int i, struct cbst *t) {
+  uint32_t node = t->root;
+  while (node) {
+    if (t->nodes[node].item == i) return true;
+    if (t->nodes[node].item < i) {
+      node = t->nodes[node].right;
+    } else {
+      node = t->nodes[node].left;
+    }
+  }
+  return false;
+}
+
+int cbst_select(int k, struct cbst *t) {
+  assert(0 <= k && k < cbst_size(t));
+  uint32_t node = t->root;
+  uint32_t rank = k;
+  while (1) {
+    uint32_t lsize = t->nodes[t->nodes[node].left].size;
+    if (rank == lsize) return t->nodes[node].item;
+    if (rank < lsize) {
+      node = t->nodes[node].left;
+    } else {
+      rank -= lsize + 1;
+      node = t->nodes[node].right;
+    }
+  }
+}
+
+// node_remove(i,node,t) removes the item i from the nodes if it exists
+// and produces the new root of the subtree
+// effects: modifies t if i is in it
+// time: O(logn)
+static uint32_t node_remove(int i, uint32_t node, struct cbst *t) {
+  if (node == 0) return 0;
+  struct cbstnode *n = &t->nodes[node];
+  if (i < n->item) {
+    n->left = node_remove(i, n->left, t);
+  } else if (i > n->item) {
+    n->right = node_remove(i, n->right, t);
+  } else {
+    if (n->left == 0 || n->right == 0) {
+      uint32_t child = n->left ? n->left : n->right;
+      node_free(node, t);
+      return child;
+    }
+    uint32_t next = n->right;
+    while (t->nodes[next].left) {
+      next = t->nodes[next].left;
+    }
+    n->item = t->nodes[next].item;
+    n->right = node_remove(n->item, n->right, t);
+  }
+  return node_balance(node, t);
+}
+
+void cbst_remove(int i, struct cbst *t) {
+  t->root = node_remove(i, t->root, t);
+}
+
+// node_rank(i,inclusive,t) produces the number of items in t that are
+// less than i (or equal to i if inclusive)
+// time: O(logn)
+static int node_rank(int i, bool inclusive, struct cbst *t) {
+  uint32_t node = t->root;
+  int rank = 0;
+  while (node) {
+    struct cbstnode *n = &t->nodes[node];
+    if (n->item < i || (inclusive && n->item == i)) {
+      rank += t->nodes[n->left].size + 1;
+      node = n->right;
+    } else {
+      node = n->left;
+    }
+  }
+  return rank;
+}
+
+int cbst_range(int start, int end, struct cbst *t) {
+  if (start > end) return 0;
+  return node_rank(end, true, t) - node_rank(start, false, t);
+}
+
+// a child weighs at most 3/4 of it's parent (see DELTA), so a cbst of
+// at most 2^32 nodes is less than 78 levels high
+#define MAX_HEIGHT 80
+
+// a walk visits the items of a cbst in an order with an explicit stack
+// of node indices (like a bst_iter), so it needs no recursion and no
+// allocation
+struct walk {
+  struct cbst *t;
+  uint32_t stack[MAX_HEIGHT];
+  int top;
+  int order;
+};
+
+// walk_push_left(w,node) pushes node and it's chain of left children
+// onto the stack of w
+// effects: modifies w
+// time: O(h)
+static void walk_push_left(struct walk *w, uint32_t node) {
+  while (node) {
+    w->stack[w->top++] = node;
+    node = w->t->nodes[node].left;
+  }
+}
+
+// walk_push_leaf(w,node) pushes the path from node down to the first
+// node in post-order among node and it's children
+// effects: modifies w
+// time: O(h)
+static void walk_push_leaf(struct walk *w, uint32_t node) {
+  while (node) {
+    w->stack[w->top++] = node;
+    struct cbstnode *n = &w->t->nodes[node];
+    node = n->left ? n->left : n->right;
+  }
+}
+
+// walk_start(w,o,t) positions w before the first item of t in order o
+// requires: o is a valid order
+// effects: modifies w
+// time: O(h)
+static void walk_start(struct walk *w, int o, struct cbst *t) {
+  assert(o == PRE_ORDER || o == IN_ORDER || o == POST_ORDER);
+  w->t = t;
+  w->top = 0;
+  w->order = o;
+  if (o == PRE_ORDER) {
+    if (t->root) w->stack[w->top++] = t->root;
+  } else if (o == IN_ORDER) {
+    walk_push_left(w, t->root);
+  } else {
+    walk_push_leaf(w, t->root);
+  }
+}
+
+// walk_next(w,i) stores the next item of w in *i and returns true, or
+// returns false if w has no more items
+// effects: modifies w, and *i if it returns true
+// time: O(1) amortized, O(h) worst case
+static bool walk_next(struct walk *w, int *i) {
+  if (w->top == 0) return false;
+  uint32_t node = w->stack[--w->top];
+  struct cbstnode *n = &w->t->nodes[node];
+  if (w->order == PRE_ORDER) {
+    if (n->right) w->stack[w->top++] = n->right;
+    if (n->left) w->stack[w->top++] = n->left;
+  } else if (w->order == IN_ORDER) {
+    walk_push_left(w, n->right);
+  } else if (w->top > 0) {
+    struct cbstnode *parent = &w->t->nodes[w->stack[w->top - 1]];
+    if (parent->left == node) walk_push_leaf(w, parent->right);
+  }
+  *i = n->item;
+  return true;
+}
+
+void cbst_print(int o, struct cbst *t) {
+  if (t->root) {
+    struct walk w;
+    int item;
+    walk_start(&w, o, t);
+    walk_next(&w, &item);
+    printf("[");
+    printf("%d", item);
+    while (walk_next(&w, &item)) {
+      printf(",%d", item);
+    }
+    printf("]\n");
+  } else {
+    printf("[empty]\n");
+  }
+}
+
+int *cbst_to_sorted_array(struct cbst *t) {
+  if (t->root == 0) return NULL;
+  int pos = 0;
+  int *result = malloc(sizeof(int) * cbst_size(t));
+  struct walk w;
+  walk_start(&w, IN_ORDER, t);
+  while (walk_next(&w, &result[pos])) {
+    pos++;
+  }
+  return result;
+}
+
+// binary_build(a,start,end,t) produces a balanced subtree of the items
+// between index start and end of a, storing a[k] in t->nodes[k + 1]
+// requires: t->nodes has room for end + 2 nodes
+// effects: modifies t
+// time: O(n)
+static uint32_t binary_build(int *a, int start, int end, struct cbst *t) {
+  if (start > end) return 0;
+  int mid = (start + end) / 2;
+  uint32_t node = mid + 1;
+  t->nodes[node].item = a[mid];
+  t->nodes[node].left = binary_build(a, start, mid - 1, t);
+  t->nodes[node].right = binary_build(a, mid + 1, end, t);
+  node_update(node, t);
+  return node;
+}
+
+struct cbst *sorted_array_to_cbst(int *a, int len) {
+  assert(a && len >= 1);
+  struct cbst *new = cbst_create();
+  new->maxlen = len + 1;
+  new->nodes = realloc(new->nodes, sizeof(struct cbstnode) * new->maxlen);
+  new->len = len + 1;
+  new->root = binary_build(a, 0, len - 1, new);
+  return new;
+}
@@ -0,0 +1,97 @@
+// Scaling of the parallel substring searches: for 1, 2, 4, ... threads
+// it times pattern_contains_parallel, pattern_find_first_parallel and
+// pattern_find_all_parallel over a haystack with no match (so every
+// byte is searched), and pattern_find_all_parallel again once matches
+// are spread through it, and prints GB/s and the speedup over one
+// thread.
+//
+// substring.h is the header part at the top of ksp_search.c. Build with
+// e.g.
+//   gcc -std=c99 -O2 -march=native -pthread ksp_search.c
+//       ksp_parallel_bench.c -o ksp_parallel_bench
+//   ./ksp_parallel_bench [MiB] [max threads]      (default 256 MiB, 8)
+// Speedups only show on a machine with that many free cores; on one
+// core every thread count runs at about the single thread speed.
+
+#include "substring.h"
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define MIN_SECONDS 0.2
+#define MAX_OUT 100000
+#define MATCHES 1000
+
+static const char NEEDLE[] = "needle-xyz";
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// seconds(which, p, hay, n, threads, out) produces the average time of
+//   search which of hay with threads threads, repeated for at least
+//   MIN_SECONDS
+// effects: may modify out
+static double seconds(int which, const struct pattern *p, const char *hay,
+                      size_t n, int threads, size_t *out) {
+  double start = now();
+  double elapsed = 0;
+  long searches = 0;
+  while (elapsed < MIN_SECONDS) {
+    if (which == 0) {
+      pattern_contains_parallel(p, hay, n, threads);
+    } else if (which == 1) {
+      pattern_find_first_parallel(p, hay, n, threads);
+    } else {
+      pattern_find_all_parallel(p, hay, n, out, MAX_OUT, threads);
+    }
+    searches++;
+    elapsed = now() - start;
+  }
+  return elapsed / searches;
+}
+
+int main(int argc, char **argv) {
+  size_t n = (size_t)(argc > 1 ? atoi(argv[1]) : 256) << 20;
+  int max = argc > 2 ? atoi(argv[2]) : 8;
+  char *hay = malloc(n);
+  size_t *out = malloc(sizeof(size_t) * MAX_OUT);
+  for (size_t i = 0; i < n; i++) {
+    hay[i] = 'a' + i * 7919 % 23;
+  }
+  size_t m = strlen(NEEDLE);
+  struct pattern *p = pattern_compile(NEEDLE, m);
+  const char *names[] = {"contains", "find_first", "find_all"};
+  printf("%-10s %-8s %7s %10s %8s\n", "search", "matches", "threads",
+         "GB/s", "speedup");
+  for (int planted = 0; planted < 2; planted++) {
+    if (planted) {
+      // contains and find_first would stop at the first match, so
+      // only find_all is timed with matches
+      size_t gap = (n - m) / MATCHES;
+      for (int k = 0; k < MATCHES; k++) {
+        memcpy(hay + gap * k + gap / 2, NEEDLE, m);
+      }
+    }
+    size_t count = pattern_count(p, hay, n);
+    assert(planted ? count == MATCHES : count == 0);
+    for (int which = planted ? 2 : 0; which < 3; which++) {
+      double one = 0;
+      for (int threads = 1; threads <= max; threads *= 2) {
+        double s = seconds(which, p, hay, n, threads, out);
+        if (threads == 1) one = s;
+        printf("%-10s %-8s %7d %10.2f %8.2f\n", names[which],
+               planted ? "spread" : "none", threads, n / s / 1e9, one / s);
+      }
+    }
+  }
+  pattern_destroy(p);
+  free(out);
+  free(hay);
+}
@@ -1,20 +1,224 @@
 #include <stdbool.h>
+#include <stddef.h>
 #substring.h
 // is_substring(haystack, needle) determines if the string
 //   needle is contained within the string haystack
 // time: O(n + m), where n & m are the lengths of haystack & needle
 bool is_substring(const char *haystack, const char *needle);
 
+// A pattern is a needle compiled once to be searched for many times.
+// The functions below take the haystack as n bytes (it may contain
+// '\0'); once a pattern is compiled, searching allocates no memory.
+// Matches may overlap: "aa" is found twice in "aaa".
+struct pattern;
+
+// pattern_compile(needle, len) returns a pattern for the len bytes of
+//   needle (needle may be freed or changed afterwards)
+// requires: needle is valid for len bytes
+// effects: allocates memory (caller must call pattern_destroy)
+// time: O(m), where m is len
+struct pattern *pattern_compile(const char *needle, size_t len);
+
+// pattern_destroy(p) frees all dynamically allocated memory
+// effects: the memory at p is invalid (freed)
+// time: O(1)
+void pattern_destroy(struct pattern *p);
+
+// pattern_find_first(p, haystack, n) returns the offset of the first
+//   match of p in haystack, or -1 if there is none
+// requires: haystack is valid for n bytes
+// time: O(n)
+long long pattern_find_first(const struct pattern *p, const char *haystack,
+                             size_t n);
+
+// pattern_find_all(p, haystack, n, out, maxout) stores the offsets of the
+//   first maxout matches of p in haystack in out, in order, and returns
+//   the number of matches (which may be more than maxout)
+// requires: haystack is valid for n bytes, out has room for maxout offsets
+//           (out may be NULL if maxout is 0)
+// effects: modifies out
+// time: O(n + k * min(m, 64)), where k is the number of matches
+size_t pattern_find_all(const struct pattern *p, const char *haystack,
+                        size_t n, size_t *out, size_t maxout);
+
+// pattern_count(p, haystack, n) returns the number of matches of p in
+//   haystack
+// requires: haystack is valid for n bytes
+// time: O(n + k * min(m, 64)), where k is the number of matches
+size_t pattern_count(const struct pattern *p, const char *haystack,
+                     size_t n);
+
+// A pattern_stream searches for a pattern in input that arrives in
+// chunks of any size (such as blocks read from a file or socket). A
+// partial match at the end of one chunk is carried into the next, and
+// matches are reported by their offset from the start of the input.
+struct pattern_stream;
+
+// pattern_stream_create(p) returns a new pattern_stream for p, at the
+//   start of the input
+// requires: p is not empty (compiled with len >= 1)
+//           p stays valid until the stream is destroyed
+// effects: allocates memory (caller must call pattern_stream_destroy)
+// time: O(1)
+struct pattern_stream *pattern_stream_create(const struct pattern *p);
+
+// pattern_stream_destroy(s) frees all dynamically allocated memory
+// effects: the memory at s is invalid (freed)
+// time: O(1)
+void pattern_stream_destroy(struct pattern_stream *s);
+
+// pattern_stream_feed(s, chunk, len, match, ctx) searches the next len
+//   bytes of the input, calls match(offset, ctx) for every match that
+//   ends in them (unless match is NULL) and returns how many there were
+// requires: chunk is valid for len bytes
+// effects: modifies s, calls match
+// time: O(len + m + k * min(m, 64)), where k is the number of matches
+size_t pattern_stream_feed(struct pattern_stream *s, const char *chunk,
+                           size_t len,
+                           void (*match)(long long offset, void *ctx),
+                           void *ctx);
+
+// pattern_scan_file(p, path, match, ctx) maps the file at path into
+//   memory (without copying it), calls match(offset, ctx) for every
+//   match of p in it (unless match is NULL), and returns how many there
+//   were, or -1 if the file could not be opened or mapped
+// effects: reads the file, calls match
+// time: O(n + k * min(m, 64)), where n is the size of the file
+long long pattern_scan_file(const struct pattern *p, const char *path,
+                            void (*match)(long long offset, void *ctx),
+                            void *ctx);
+
+// the _parallel versions below split the haystack into one segment per
+//   thread (segments overlap by m - 1 bytes, so no match is missed), and
+//   fall back to one thread for small haystacks
+
+// pattern_contains_parallel(p, haystack, n, threads) determines if p is
+//   found in haystack, using up to threads threads; every thread stops
+//   as soon as any of them finds a match
+// requires: haystack is valid for n bytes, threads >= 1
+// time: O(n / threads + m)
+bool pattern_contains_parallel(const struct pattern *p, const char *haystack,
+                               size_t n, int threads);
+
+// pattern_find_first_parallel(p, haystack, n, threads) is
+//   pattern_find_first using up to threads threads; a thread stops once
+//   a match has been found before the part it is searching
+// requires: haystack is valid for n bytes, threads >= 1
+// time: O(n / threads + m)
+long long pattern_find_first_parallel(const struct pattern *p,
+                                      const char *haystack, size_t n,
+                                      int threads);
+
+// pattern_find_all_parallel(p, haystack, n, out, maxout, threads) is
+//   pattern_find_all using up to threads threads (the offsets in out are
+//   still in order)
+// requires: same as pattern_find_all, threads >= 1
+// effects: modifies out
+// time: O(n / threads + k * min(m, 64) + m)
+size_t pattern_find_all_parallel(const struct pattern *p,
+                                 const char *haystack, size_t n,
+                                 size_t *out, size_t maxout, int threads);
+
 #include "substring.h"
+#define _POSIX_C_SOURCE 200809L   // posix_madvise
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+// a search produces the index of the first match, or NONE
+static const size_t NONE = SIZE_MAX;
+
+// needles up to SIMD_NEEDLE bytes are searched with the vector filter:
+// it compares the first and last bytes of the needle against 16 (SSE2)
+// or 32 (AVX2) positions of the haystack at once, and only the
+// candidates that pass are compared in full. Periodic needles (such as
+// "aaab" in "aaaa...") can make most candidates fail; once more than
+// MISS_SLACK + i / 16 candidates have failed in the first i bytes, the
+// search goes on with KMP, so the worst case stays linear.
+#define SIMD_NEEDLE 64
+#define MISS_SLACK 32
+
+// Longer needles are searched by one of two engines, chosen by the
+// period of the needle:
+//   - Horspool, if the needle is not periodic: it compares the last byte
+//     of the needle first and on a mismatch skips ahead by up to the
+//     length of the needle, so it usually reads a small part of the
+//     haystack. Its worst case is O(nm), so it gives up (and Two-Way
+//     goes on) after too many failed comparisons, as the vector filter
+//     does.
+//   - Two-Way (Crochemore and Perrin), if the needle is periodic (such
+//     as "abcabcabc...ab"): it is linear in the worst case and needs no
+//     memory beyond the needle's critical factorization.
+// KMP is kept for chunked input (pattern_stream), which needs it's state.
+
+// table is the KMP failure function of needle (see kmp_table), or NULL
+//   for a search that builds it only if needed; both are stored in the
+//   same block as the pattern
+// for needles longer than SIMD_NEEDLE:
+//   needle[0 ... critical] and the rest are the critical factorization
+//   of the needle (critical may be -1) and period is the period used by
+//   Two-Way; the needle is periodic if it repeats with that period
+//   skip[c] is how far Horspool moves when the haystack byte under the
+//   last byte of the needle is c
+struct pattern {
+  size_t len;
+  const char *needle;
+  int *table;
+  long long critical;
+  size_t period;
+  bool periodic;
+  size_t skip[256];
+};
+
+// state is the number of bytes of the needle matched at the end of the
+// input so far, and offset is the length of the input so far
+struct pattern_stream {
+  const struct pattern *p;
+  int state;
+  long long offset;
+};
+
+// kmp_table(needle, len, table) fills table with the KMP failure function
+// of needle: table[i] is the length of the longest proper prefix of
+// needle[0..i] that is also a suffix of it
+// requires: len >= 1, table has room for len ints
+// effects: modifies table
+// time: O(len)
+static void kmp_table(const char *needle, int len, int *table) {
+  int j = 0;
+  int i = 1;
+  table[0] = 0;
+
+  while (i < len) {
+    if ( needle[j] == needle[i] ) {
+      table[i] = j + 1;
+      i++;
+      j++;
+    } else if (j != 0) {
+      j = table[j - 1];
+    } else {
+      table[i] = 0;
+      i++;
+    }
+  }
+}
 
 // preffix(needle) produces a temporary array based on the KMP algorithm
 // Every element in the arrary correspond to the element with same index
-// in the string needle and tells if the charrecter is a duplicate 
-// or not. If the character has already shown in the arrary, then the 
-// element in the produced array indicates the index where the most 
+// in the string needle and tells if the charrecter is a duplicate
+// or not. If the character has already shown in the arrary, then the
+// element in the produced array indicates the index where the most
 // recent shown time of this duplicate.
 // effect: allocates memory (caller must free)
 // runtime: O (n) n is the length of needle;
@@ -22,72 +226,629 @@ bool is_substring(const char *haystack, const char *needle);
 int *preffix (const char *needle) {
   int len = strlen(needle);
   int* result = malloc( len * sizeof(int) );
-  int j = 0;
-  int i = 1;
-  result[0] = 0;
+  kmp_table(needle, len, result);
+  return result;
+}
 
-  while (1) {
-    if (i == len) break;
-    if ( needle[j] == needle[i] ) {
-      result[i] = j + 1;
-      i++;
-      j++;
+// kmp_scan(haystack, n, needle, m, table, pos, state) runs KMP over
+// haystack from pos, where *state bytes of needle are already matched,
+// and produces the offset just past the end of the first match (then
+// *state is ready to go on after it), or NONE if it reaches n first
+// requires: table is the kmp_table of needle, m >= 1, 0 <= *state < m
+// effects: modifies *state
+// time: O(n - pos)
+static size_t kmp_scan(const char *haystack, size_t n, const char *needle,
+                       int m, const int *table, size_t pos, int *state) {
+  int pos0 = *state;
+  while (pos < n) {
+    if (haystack[pos] == needle[pos0]) {
+      pos++;
+      pos0++;
+      if (pos0 == m) {
+        *state = table[m - 1];
+        return pos;
+      }
+    } else if (pos0 != 0) {
+      pos0 = table[pos0 - 1];
     } else {
-      if ( (needle[j] != needle[i]) && (j != 0) ) {
-        j = result[j - 1];
+      pos++;
+    }
+  }
+  *state = pos0;
+  return NONE;
+}
+
+// naive_find(haystack, n, needle, m, pos) finds the first match of needle
+// in haystack that starts at pos or later by trying every start
+// time: O((n - pos) * m)
+static size_t naive_find(const char *haystack, size_t n, const char *needle,
+                         size_t m, size_t pos) {
+  for (; pos + m <= n; pos++) {
+    if (memcmp(haystack + pos, needle, m) == 0) return pos;
+  }
+  return NONE;
+}
+
+#ifdef HAVE_X86_SIMD
+// sse2_find(haystack, n, needle, m, stop) finds the first match of needle
+// in haystack with the vector filter; if it gives up (see SIMD_NEEDLE),
+// it stores in *stop the first start it has not ruled out, and
+// otherwise it stores NONE
+// requires: 2 <= m <= n
+// time: O(n + MISS_SLACK * m)
+__attribute__((target("sse2")))
+static size_t sse2_find(const char *haystack, size_t n, const char *needle,
+                        size_t m, size_t *stop) {
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[m - 1]);
+  size_t misses = 0;
+  size_t i = 0;
+  *stop = NONE;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(haystack + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(haystack + i + m - 1));
+    unsigned mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+    while (mask) {
+      size_t at = i + __builtin_ctz(mask);
+      if (memcmp(haystack + at + 1, needle + 1, m - 2) == 0) return at;
+      if (++misses > MISS_SLACK + i / 16) {
+        *stop = at + 1;
+        return NONE;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return naive_find(haystack, n, needle, m, i);
+}
+
+// avx2_find(haystack, n, needle, m, stop) is sse2_find, 32 bytes at a time
+// requires: 2 <= m <= n, the cpu supports AVX2
+// time: O(n + MISS_SLACK * m)
+__attribute__((target("avx2")))
+static size_t avx2_find(const char *haystack, size_t n, const char *needle,
+                        size_t m, size_t *stop) {
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[m - 1]);
+  size_t misses = 0;
+  size_t i = 0;
+  *stop = NONE;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(haystack + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(haystack + i + m - 1));
+    unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+    while (mask) {
+      size_t at = i + __builtin_ctz(mask);
+      if (memcmp(haystack + at + 1, needle + 1, m - 2) == 0) return at;
+      if (++misses > MISS_SLACK + i / 16) {
+        *stop = at + 1;
+        return NONE;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return naive_find(haystack, n, needle, m, i);
+}
+#endif
+
+// maximal_suffix(needle, m, reverse, period) produces the start - 1 of
+// the lexicographically largest suffix of needle (the smallest one if
+// reverse is true), and stores it's period in *period
+// requires: m >= 1
+// effects: modifies *period
+// time: O(m)
+static long long maximal_suffix(const char *needle, long long m,
+                                bool reverse, size_t *period) {
+  const unsigned char *x = (const unsigned char *)needle;
+  long long ms = -1;
+  long long j = 0;
+  long long k = 1;
+  long long p = 1;
+  while (j + k < m) {
+    unsigned char a = x[j + k];
+    unsigned char b = x[ms + k];
+    if (reverse ? a > b : a < b) {
+      j += k;
+      k = 1;
+      p = j - ms;
+    } else if (a == b) {
+      if (k != p) {
+        k++;
       } else {
-        if ( (needle[j] != needle[i]) && (j == 0) ) {
-          result[i] = 0;
-          i++;
-        } else {
-          continue;
-        }
+        j += p;
+        k = 1;
       }
+    } else {
+      ms = j;
+      j = ms + 1;
+      k = 1;
+      p = 1;
     }
   }
-  return result;
+  *period = p;
+  return ms;
+}
+
+// plan(p) fills in the fields of p used by Horspool and Two-Way
+// requires: p->needle and p->len are set, p->len > SIMD_NEEDLE
+// effects: modifies p
+// time: O(m)
+static void plan(struct pattern *p) {
+  const char *needle = p->needle;
+  size_t m = p->len;
+  size_t period;
+  size_t reverse_period;
+  long long critical = maximal_suffix(needle, m, false, &period);
+  long long reverse_critical = maximal_suffix(needle, m, true,
+                                              &reverse_period);
+  if (reverse_critical > critical) {
+    critical = reverse_critical;
+    period = reverse_period;
+  }
+  p->critical = critical;
+  p->periodic = memcmp(needle, needle + period, critical + 1) == 0;
+  if (!p->periodic) {
+    // the halves can not overlap by more than the larger one
+    size_t left = critical + 1;
+    size_t right = m - critical - 1;
+    period = (left > right ? left : right) + 1;
+  }
+  p->period = period;
+  for (int c = 0; c < 256; c++) {
+    p->skip[c] = m;
+  }
+  for (size_t i = 0; i + 1 < m; i++) {
+    p->skip[(unsigned char)needle[i]] = m - 1 - i;
+  }
+}
+
+// horspool_find(p, haystack, n, stop) finds the first match of p in
+// haystack with Horspool; if it gives up (see SIMD_NEEDLE), it stores in
+// *stop the first start it has not ruled out, and otherwise it stores
+// NONE
+// requires: p is planned, m <= n
+// time: O(n + MISS_SLACK * m)
+static size_t horspool_find(const struct pattern *p, const char *haystack,
+                            size_t n, size_t *stop) {
+  const char *needle = p->needle;
+  size_t m = p->len;
+  char last = needle[m - 1];
+  size_t misses = 0;
+  *stop = NONE;
+  for (size_t i = 0; i + m <= n; ) {
+    char c = haystack[i + m - 1];
+    if (c == last) {
+      if (memcmp(haystack + i, needle, m - 1) == 0) return i;
+      if (++misses > MISS_SLACK + 4 * (i / m)) {
+        *stop = i + 1;
+        return NONE;
+      }
+    }
+    i += p->skip[(unsigned char)c];
+  }
+  return NONE;
 }
 
+// two_way_find(p, haystack, n, pos) finds the first match of p in
+// haystack that starts at pos or later with Two-Way: the right part of
+// the needle is compared left to right, then the left part right to
+// left; for a periodic needle, memory is how much of the left part is
+// known to match after a shift by the period
+// requires: p is planned
+// time: O(n - pos)
+static size_t two_way_find(const struct pattern *p, const char *haystack,
+                           size_t n, size_t pos) {
+  const char *x = p->needle;
+  long long m = p->len;
+  long long ell = p->critical;
+  long long per = p->period;
+  long long memory = -1;
+  for (long long j = pos; j + m <= (long long)n; ) {
+    const char *y = haystack + j;
+    long long i = (p->periodic && memory > ell ? memory : ell) + 1;
+    while (i < m && x[i] == y[i]) i++;
+    if (i < m) {
+      j += i - ell;
+      memory = -1;
+      continue;
+    }
+    long long low = p->periodic ? memory : -1;
+    i = ell;
+    while (i > low && x[i] == y[i]) i--;
+    if (i <= low) return j;
+    j += per;
+    memory = p->periodic ? m - per - 1 : -1;
+  }
+  return NONE;
+}
+
+// search(p, haystack, n) finds the first match of p in the n bytes of
+// haystack, using the vector filter for needles up to SIMD_NEEDLE bytes
+// (AVX2 if the cpu has it, then KMP if it gives up), and Horspool or
+// Two-Way for longer ones
+// requires: p is planned if m > SIMD_NEEDLE
+// time: O(n + m)
+static size_t search(const struct pattern *p, const char *haystack,
+                     size_t n) {
+  const char *needle = p->needle;
+  size_t m = p->len;
+  if (m == 0) return 0;
+  if (m > n) return NONE;
+  if (m == 1) {
+    const char *at = memchr(haystack, needle[0], n);
+    return at ? (size_t)(at - haystack) : NONE;
+  }
+  size_t pos = 0;
+  if (m > SIMD_NEEDLE) {
+    if (!p->periodic) {
+      size_t at = horspool_find(p, haystack, n, &pos);
+      if (pos == NONE) return at;
+    }
+    return two_way_find(p, haystack, n, pos);
+  }
+#ifdef HAVE_X86_SIMD
+  size_t at = NONE;
+  if (__builtin_cpu_supports("avx2")) {
+    at = avx2_find(haystack, n, needle, m, &pos);
+  } else if (__builtin_cpu_supports("sse2")) {
+    at = sse2_find(haystack, n, needle, m, &pos);
+  }
+  if (pos == NONE) return at;
+#endif
+  int stack_table[SIMD_NEEDLE];
+  const int *table = p->table;
+  if (table == NULL) {
+    kmp_table(needle, m, stack_table);
+    table = stack_table;
+  }
+  int state = 0;
+  size_t end = kmp_scan(haystack, n, needle, m, table, pos, &state);
+  return end == NONE ? NONE : end - m;
+}
 
 bool is_substring(const char *haystack, const char *needle) {
-  int pos = 0;
-  int pos0 = 0;
-  int haylen = strlen(haystack);
-  int needlen = strlen(needle);
-  bool result = false;
-  if (needlen == 0) {
-    return true;
-  } else {
-    if (needlen > haylen) {
-      return false;
+  struct pattern p;
+  p.len = strlen(needle);
+  p.needle = needle;
+  p.table = NULL;
+  if (p.len > SIMD_NEEDLE) plan(&p);
+  return search(&p, haystack, strlen(haystack)) != NONE;
+}
+
+struct pattern *pattern_compile(const char *needle, size_t len) {
+  struct pattern *new = malloc(sizeof(struct pattern) +
+                               len * sizeof(int) + len);
+  new->len = len;
+  new->table = (int *)(new + 1);
+  new->needle = (char *)(new->table + len);
+  memcpy((char *)new->needle, needle, len);
+  if (len > 0) kmp_table(new->needle, len, new->table);
+  if (len > SIMD_NEEDLE) plan(new);
+  return new;
+}
+
+void pattern_destroy(struct pattern *p) {
+  free(p);
+}
+
+long long pattern_find_first(const struct pattern *p, const char *haystack,
+                             size_t n) {
+  size_t at = search(p, haystack, n);
+  return at == NONE ? -1 : (long long)at;
+}
+
+// find_each(p, haystack, n, base, match, ctx) calls match(base + at, ctx)
+// for the offset at of every match of p in haystack (unless match is
+// NULL) and produces how many there were
+// effects: calls match
+// time: O(n + k * min(m, 64)), where k is the number of matches
+static size_t find_each(const struct pattern *p, const char *haystack,
+                        size_t n, long long base,
+                        void (*match)(long long offset, void *ctx),
+                        void *ctx) {
+  size_t m = p->len;
+  size_t count = 0;
+  if (m == 0) {
+    // the empty needle matches at every offset, 0 ... n
+    for (size_t at = 0; at <= n; at++) {
+      if (match) match(base + at, ctx);
+      count++;
+    }
+    return count;
+  }
+  if (m <= SIMD_NEEDLE || !p->periodic) {
+    // restart the search just past each match (matches of a long needle
+    // that is not periodic are more than m / 2 bytes apart, so this is
+    // still linear)
+    size_t pos = 0;
+    while (pos + m <= n) {
+      size_t at = search(p, haystack + pos, n - pos);
+      if (at == NONE) break;
+      if (match) match(base + pos + at, ctx);
+      count++;
+      pos += at + 1;
+    }
+    return count;
+  }
+  // KMP goes on from each match without looking back
+  size_t pos = 0;
+  int state = 0;
+  while (1) {
+    size_t end = kmp_scan(haystack, n, p->needle, m, p->table, pos, &state);
+    if (end == NONE) break;
+    if (match) match(base + end - m, ctx);
+    count++;
+    pos = end;
+  }
+  return count;
+}
+
+// collect is the ctx of collect_match, which stores the first maxout
+// offsets it is called with in out
+struct collect {
+  size_t *out;
+  size_t maxout;
+  size_t count;
+};
+
+static void collect_match(long long offset, void *ctx) {
+  struct collect *c = ctx;
+  if (c->count < c->maxout) c->out[c->count] = offset;
+  c->count++;
+}
+
+size_t pattern_find_all(const struct pattern *p, const char *haystack,
+                        size_t n, size_t *out, size_t maxout) {
+  struct collect c = {out, maxout, 0};
+  return find_each(p, haystack, n, 0, collect_match, &c);
+}
+
+size_t pattern_count(const struct pattern *p, const char *haystack,
+                     size_t n) {
+  return find_each(p, haystack, n, 0, NULL, NULL);
+}
+
+struct pattern_stream *pattern_stream_create(const struct pattern *p) {
+  assert(p->len >= 1);
+  struct pattern_stream *new = malloc(sizeof(struct pattern_stream));
+  new->p = p;
+  new->state = 0;
+  new->offset = 0;
+  return new;
+}
+
+void pattern_stream_destroy(struct pattern_stream *s) {
+  free(s);
+}
+
+// A match that ends in the first m - 1 bytes of a chunk started in an
+// earlier chunk, so KMP (with the state carried over) finds those; the
+// matches that lie inside the chunk are found by find_each. Since the
+// state is shorter than m, it depends only on the last m - 1 bytes of
+// the input, so KMP from state 0 over them finds the new state.
+size_t pattern_stream_feed(struct pattern_stream *s, const char *chunk,
+                           size_t len,
+                           void (*match)(long long offset, void *ctx),
+                           void *ctx) {
+  const struct pattern *p = s->p;
+  int m = p->len;
+  size_t head = len < (size_t)m - 1 ? len : (size_t)m - 1;
+  size_t count = 0;
+  size_t pos = 0;
+  while (1) {
+    size_t end = kmp_scan(chunk, head, p->needle, m, p->table, pos,
+                          &s->state);
+    if (end == NONE) break;
+    if (match) match(s->offset + (long long)end - m, ctx);
+    count++;
+    pos = end;
+  }
+  if (len > head) {
+    count += find_each(p, chunk, len, s->offset, match, ctx);
+    s->state = 0;
+    kmp_scan(chunk, len, p->needle, m, p->table, len - head, &s->state);
+  }
+  s->offset += len;
+  return count;
+}
+
+long long pattern_scan_file(const struct pattern *p, const char *path,
+                            void (*match)(long long offset, void *ctx),
+                            void *ctx) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  long long count = -1;
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    if (st.st_size == 0) {
+      count = find_each(p, "", 0, 0, match, ctx);
     } else {
-      int* info = preffix(needle);
-      while (1) {
-        if (pos == haylen) {
-          break;
-        } else {
-          if (pos0 == needlen) {
-            result = true;
-            break;
-          } else {
-            if (haystack[pos] == needle[pos0]) {
-              pos++;
-              pos0++;
-            } else {
-              if (pos0 != 0) {
-                pos0 = info[pos0 - 1];
-              } else {
-                pos++;
-              }
-            }
-          }
-        }
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+        count = find_each(p, map, st.st_size, 0, match, ctx);
+        munmap(map, st.st_size);
+      }
+    }
+  }
+  close(fd);
+  return count;
+}
+
+// a haystack is split into segments of at least GRAIN bytes, and a
+// search for the first match looks at the others after every BLOCK bytes
+static const size_t GRAIN = 1 << 20;
+static const size_t BLOCK = 1 << 18;
+
+// a searchtask searches for the matches of p that start in
+// haystack[start ... end - 1] (reading up to m - 1 bytes past end)
+// best is shared by the tasks of one search: the smallest offset of a
+//   match found so far (NONE if none), and if any is true a task stops
+//   as soon as best is not NONE
+// for find-all, the first maxfound offsets are stored in found (which
+//   has room for cap, and grows as needed), and count is the number of
+//   matches
+struct searchtask {
+  const struct pattern *p;
+  const char *haystack;
+  size_t n;
+  size_t start;
+  size_t end;
+  size_t *best;
+  bool any;
+  size_t *found;
+  size_t cap;
+  size_t maxfound;
+  size_t count;
+};
+
+// first_task(arg) searches for the first match of the searchtask at arg,
+// BLOCK bytes at a time, and records it in best
+// effects: modifies best
+// time: O((end - start) + m)
+static void *first_task(void *arg) {
+  struct searchtask *task = arg;
+  size_t m = task->p->len;
+  for (size_t at = task->start; at < task->end; at += BLOCK) {
+    size_t best = __atomic_load_n(task->best, __ATOMIC_RELAXED);
+    if (best != NONE && (task->any || best < at)) break;
+    size_t stop = at + BLOCK < task->end ? at + BLOCK : task->end;
+    size_t limit = stop + m - 1 < task->n ? stop + m - 1 : task->n;
+    size_t found = search(task->p, task->haystack + at, limit - at);
+    if (found != NONE) {
+      found += at;
+      // keep the smallest offset found by any task
+      best = __atomic_load_n(task->best, __ATOMIC_RELAXED);
+      while (found < best &&
+             !__atomic_compare_exchange_n(task->best, &best, found, true,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED)) {
       }
-      free(info);
-      return result;
+      break;
     }
   }
+  return NULL;
 }
 
+// all_match(offset, ctx) stores offset in the searchtask at ctx
+static void all_match(long long offset, void *ctx) {
+  struct searchtask *task = ctx;
+  if (task->count < task->maxfound) {
+    if (task->count == task->cap) {
+      task->cap = task->cap ? 2 * task->cap : 64;
+      if (task->cap > task->maxfound) task->cap = task->maxfound;
+      task->found = realloc(task->found, sizeof(size_t) * task->cap);
+    }
+    task->found[task->count] = offset;
+  }
+  task->count++;
+}
 
+// all_task(arg) finds all matches of the searchtask at arg
+// effects: modifies the searchtask
+// time: O((end - start) + k * min(m, 64) + m)
+static void *all_task(void *arg) {
+  struct searchtask *task = arg;
+  size_t m = task->p->len;
+  size_t limit = task->end + m - 1 < task->n ? task->end + m - 1 : task->n;
+  find_each(task->p, task->haystack + task->start, limit - task->start,
+            task->start, all_match, task);
+  return NULL;
+}
 
+// run_tasks(p, n, threads, run, tasks) splits the starts of matches of p
+// in a haystack of n bytes into up to threads segments, one for each of
+// tasks (fields start and end), runs run on each of them, every one but
+// the first in a new thread, and produces the number of segments
+// requires: 1 <= m <= n, tasks has room for threads searchtasks, whose
+//           other fields are set
+// effects: modifies tasks
+// time: O(threads), plus the time of run
+static int run_tasks(const struct pattern *p, size_t n, int threads,
+                     void *(*run)(void *), struct searchtask *tasks) {
+  size_t starts = n - p->len + 1;
+  size_t segments = starts / GRAIN;
+  if (segments > (size_t)threads) segments = threads;
+  if (segments < 1) segments = 1;
+  pthread_t *thread = malloc(sizeof(pthread_t) * segments);
+  bool *forked = malloc(sizeof(bool) * segments);
+  for (size_t i = 0; i < segments; i++) {
+    tasks[i].start = starts / segments * i;
+    tasks[i].end = i + 1 == segments ? starts : starts / segments * (i + 1);
+  }
+  for (size_t i = 1; i < segments; i++) {
+    forked[i] = pthread_create(&thread[i], NULL, run, &tasks[i]) == 0;
+    if (!forked[i]) run(&tasks[i]);
+  }
+  run(&tasks[0]);
+  for (size_t i = 1; i < segments; i++) {
+    if (forked[i]) pthread_join(thread[i], NULL);
+  }
+  free(thread);
+  free(forked);
+  return segments;
+}
+
+// first_parallel(p, haystack, n, threads, any) finds the first match of
+// p in haystack with first_task, or any match if any is true
+// time: O(n / threads + m)
+static size_t first_parallel(const struct pattern *p, const char *haystack,
+                             size_t n, int threads, bool any) {
+  if (p->len == 0 || p->len > n) {
+    return search(p, haystack, n);
+  }
+  size_t best = NONE;
+  struct searchtask *tasks = malloc(sizeof(struct searchtask) * threads);
+  for (int i = 0; i < threads; i++) {
+    struct searchtask task = {p, haystack, n, 0, 0, &best, any,
+                              NULL, 0, 0, 0};
+    tasks[i] = task;
+  }
+  run_tasks(p, n, threads, first_task, tasks);
+  free(tasks);
+  return best;
+}
+
+bool pattern_contains_parallel(const struct pattern *p, const char *haystack,
+                               size_t n, int threads) {
+  return first_parallel(p, haystack, n, threads, true) != NONE;
+}
+
+long long pattern_find_first_parallel(const struct pattern *p,
+                                      const char *haystack, size_t n,
+                                      int threads) {
+  size_t at = first_parallel(p, haystack, n, threads, false);
+  return at == NONE ? -1 : (long long)at;
+}
+
+size_t pattern_find_all_parallel(const struct pattern *p,
+                                 const char *haystack, size_t n,
+                                 size_t *out, size_t maxout, int threads) {
+  if (p->len == 0 || p->len > n) {
+    return pattern_find_all(p, haystack, n, out, maxout);
+  }
+  // each task keeps up to maxout offsets of it's own, and they are copied
+  // to out in order of segment
+  struct searchtask *tasks = malloc(sizeof(struct searchtask) * threads);
+  for (int i = 0; i < threads; i++) {
+    struct searchtask task = {p, haystack, n, 0, 0, NULL, false,
+                              NULL, 0, maxout, 0};
+    tasks[i] = task;
+  }
+  int segments = run_tasks(p, n, threads, all_task, tasks);
+  size_t count = 0;
+  for (int i = 0; i < segments; i++) {
+    size_t copy = tasks[i].count < tasks[i].maxfound ? tasks[i].count
+                                                     : tasks[i].maxfound;
+    size_t room = count < maxout ? maxout - count : 0;
+    if (copy > room) copy = room;
+    if (copy > 0) memcpy(out + count, tasks[i].found, sizeof(size_t) * copy);
+    count += tasks[i].count;
+  }
+  for (int i = 0; i < threads; i++) {
+    free(tasks[i].found);
+  }
+  free(tasks);
+  return count;
+}
@@ -0,0 +1,177 @@
+// Benchmark of the substring search against the C library: for every
+// input and needle length it times pattern_find_first (compiled once),
+// is_substring, memmem and strstr up to the first match and prints the
+// bytes searched per second (GB/s). is_substring and strstr also find
+// the length of the whole haystack, which dominates when the match is
+// near the start.
+//
+// Realistic inputs are english-like text, DNA and random bytes, with
+// needles cut from the end of the haystack (so short ones are usually
+// found earlier, as in real searches). Adversarial inputs are the ones
+// that are quadratic for a naive search: "aaa...ab" and "baa...a" in
+// "aaa...", and a periodic needle that matches almost everywhere.
+//
+// substring.h is the header part at the top of ksp_search.c. Build with
+// e.g.
+//   gcc -std=c99 -O2 -march=native -pthread ksp_search.c
+//       ksp_search_bench.c -o ksp_search_bench
+//   ./ksp_search_bench [MiB]                          (default 16 MiB)
+
+#include "substring.h"
+#define _GNU_SOURCE   // memmem, clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define MIN_SECONDS 0.05
+
+static const int LENS[] = {4, 16, 64, 256, 2048};
+static const int NLENS = sizeof(LENS) / sizeof(LENS[0]);
+
+static const char *WORDS[] = {
+  "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as",
+  "was", "with", "be", "by", "on", "not", "he", "this", "are", "or",
+  "his", "from", "at", "which", "but", "have", "an", "had", "they",
+  "search", "pattern", "needle", "haystack", "memory", "cache", "line",
+  "vector", "period", "suffix", "table", "thread", "segment", "match",
+};
+static const int NWORDS = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r >> 8;
+}
+
+// fill(hay, n, kind) fills the n bytes of hay with one kind of input and
+//   ends it with '\0' (no other byte of hay is '\0')
+// effects: modifies hay
+static void fill(char *hay, size_t n, const char *kind) {
+  unsigned r = 42;
+  if (strcmp(kind, "text") == 0) {
+    size_t pos = 0;
+    while (pos < n) {
+      const char *word = WORDS[next_random(&r) % NWORDS];
+      for (size_t i = 0; word[i] && pos < n; i++) {
+        hay[pos++] = word[i];
+      }
+      if (pos < n) hay[pos++] = next_random(&r) % 12 ? ' ' : '\n';
+    }
+  } else if (strcmp(kind, "dna") == 0) {
+    for (size_t i = 0; i < n; i++) {
+      hay[i] = "ACGT"[next_random(&r) % 4];
+    }
+  } else if (strcmp(kind, "binary") == 0) {
+    for (size_t i = 0; i < n; i++) {
+      hay[i] = 1 + next_random(&r) % 255;
+    }
+  } else if (strcmp(kind, "periodic") == 0) {
+    for (size_t i = 0; i < n; i++) {
+      hay[i] = i % 7 == 0 ? 'a' : 'b';
+    }
+  } else {
+    memset(hay, 'a', n);
+  }
+  hay[n] = '\0';
+}
+
+// make_needle(needle, m, hay, n, kind) stores a needle of length m for
+//   the kind of input in needle: realistic needles are the last m bytes
+//   of hay, adversarial ones are not in hay at all
+// effects: modifies needle
+static void make_needle(char *needle, int m, const char *hay, size_t n,
+                        const char *kind) {
+  if (strcmp(kind, "a^(m-1)b") == 0) {
+    memset(needle, 'a', m);
+    needle[m - 1] = 'b';
+  } else if (strcmp(kind, "ba^(m-1)") == 0) {
+    memset(needle, 'a', m);
+    needle[0] = 'b';
+  } else if (strcmp(kind, "periodic") == 0) {
+    for (int i = 0; i < m; i++) {
+      needle[i] = i % 7 == 0 ? 'a' : 'b';
+    }
+    needle[m - 1] = 'c';
+  } else {
+    memcpy(needle, hay + n - m, m);
+  }
+  needle[m] = '\0';
+}
+
+// seconds(which, p, needle, m, hay, n, expected) produces the average
+//   time of searching hay for needle with search which, repeated for at
+//   least MIN_SECONDS, checking that every search finds expected (the
+//   first match, or -1)
+static double seconds(int which, const struct pattern *p, const char *needle,
+                      int m, const char *hay, size_t n, long long expected) {
+  double start = now();
+  double elapsed = 0;
+  long searches = 0;
+  while (elapsed < MIN_SECONDS) {
+    long long found;
+    if (which == 0) {
+      found = pattern_find_first(p, hay, n);
+    } else if (which == 1) {
+      found = is_substring(hay, needle) ? expected : -1;
+    } else if (which == 2) {
+      const char *at = memmem(hay, n, needle, m);
+      found = at ? at - hay : -1;
+    } else {
+      const char *at = strstr(hay, needle);
+      found = at ? at - hay : -1;
+    }
+    assert(found == expected);
+    searches++;
+    elapsed = now() - start;
+  }
+  return elapsed / searches;
+}
+
+int main(int argc, char **argv) {
+  size_t n = (size_t)(argc > 1 ? atoi(argv[1]) : 16) << 20;
+  char *hay = malloc(n + 1);
+  static char needle[2048 + 1];
+  const char *kinds[][2] = {
+    {"text", "text"}, {"dna", "dna"}, {"binary", "binary"},
+    {"a", "a^(m-1)b"}, {"a", "ba^(m-1)"}, {"periodic", "periodic"},
+  };
+  const char *names[] = {"pattern", "is_substring", "memmem", "strstr"};
+  printf("%-10s %-10s %5s", "haystack", "needle", "m");
+  for (int which = 0; which < 4; which++) {
+    printf(" %12s", names[which]);
+  }
+  printf("   (GB/s)\n");
+  for (int k = 0; k < 6; k++) {
+    for (int l = 0; l < NLENS; l++) {
+      int m = LENS[l];
+      fill(hay, n, kinds[k][0]);
+      make_needle(needle, m, hay, n, kinds[k][1]);
+      long long expected = -1;
+      if (strcmp(kinds[k][0], kinds[k][1]) == 0 &&
+          strcmp(kinds[k][0], "periodic") != 0) {
+        const char *at = memmem(hay, n, needle, m);
+        expected = at - hay;
+      }
+      size_t searched = expected >= 0 ? (size_t)expected + m : n;
+      struct pattern *p = pattern_compile(needle, m);
+      printf("%-10s %-10s %5d", kinds[k][0], kinds[k][1], m);
+      for (int which = 0; which < 4; which++) {
+        double s = seconds(which, p, needle, m, hay, n, expected);
+        printf(" %12.2f", searched / s / 1e9);
+      }
+      printf("\n");
+      pattern_destroy(p);
+    }
+  }
+  free(hay);
+}
@@ -0,0 +1,170 @@
+// Regression tests for the substring search: every search path (the
+// vector filter for short needles, Horspool and Two-Way for long ones,
+// streams) is compared with a brute force search on random inputs, and
+// the adversarial inputs that are quadratic for a naive search
+// ("aaaa...ab" and friends) must still be found correctly and quickly.
+//
+// substring.h is the header part at the top of ksp_search.c. Build with
+// e.g.
+//   gcc -std=c99 -O1 -g -fsanitize=address,undefined -pthread
+//       ksp_search.c ksp_search_test.c -o ksp_search_test
+// It prints "OK", or stops at a failed assert.
+
+#include "substring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#define MAX_HAY 20000
+#define MAX_NEEDLE 2000
+#define ROUNDS 30000
+
+// brute_force(hay, n, needle, m, out) stores the offsets of all matches
+//   of needle in hay in out and produces how many there are
+// effects: modifies out
+// time: O(nm)
+static size_t brute_force(const char *hay, size_t n, const char *needle,
+                          size_t m, size_t *out) {
+  size_t k = 0;
+  for (size_t i = 0; i + m <= n; i++) {
+    if (memcmp(hay + i, needle, m) == 0) out[k++] = i;
+  }
+  return k;
+}
+
+struct offsets {
+  size_t *at;
+  size_t len;
+};
+
+// record(offset, ctx) appends the offset of a stream match to ctx
+static void record(long long offset, void *ctx) {
+  struct offsets *o = ctx;
+  o->at[o->len++] = offset;
+}
+
+// make_input(hay, n, needle, m, kind) fills hay and needle with one kind
+//   of input: random text over a small alphabet, a periodic needle in a
+//   haystack made of it's period, or "aaa...ab" in "aaa..."; some copies
+//   of the needle are then planted in hay
+// effects: modifies hay and needle
+static void make_input(char *hay, int n, char *needle, int m, int kind) {
+  int alpha = 1 + rand() % 4;
+  int period = 1 + rand() % 10;
+  for (int i = 0; i < m; i++) {
+    if (kind == 2) {
+      needle[i] = i < m - 1 ? 'a' : 'b';
+    } else if (kind == 1 && i >= period) {
+      needle[i] = needle[i - period];
+    } else {
+      needle[i] = 'a' + rand() % alpha;
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (kind == 2) {
+      hay[i] = 'a';
+    } else if (kind == 1) {
+      hay[i] = needle[i % period];
+    } else {
+      hay[i] = 'a' + rand() % alpha;
+    }
+  }
+  for (int copies = rand() % 4; copies > 0 && n > m; copies--) {
+    memcpy(hay + rand() % (n - m + 1), needle, m);
+  }
+  hay[n] = '\0';
+  needle[m] = '\0';
+}
+
+// test_random() compares every search with brute_force on ROUNDS random
+//   inputs, with needles of every length up to MAX_NEEDLE
+static void test_random(void) {
+  static char hay[MAX_HAY + 1];
+  static char needle[MAX_NEEDLE + 1];
+  static size_t expected[MAX_HAY + 1];
+  static size_t found[MAX_HAY + 1];
+  srand(17);
+  for (int round = 0; round < ROUNDS; round++) {
+    int n = rand() % (round % 10 == 0 ? MAX_HAY : 3000);
+    int m = round % 3 == 0 ? 1 + rand() % 64 :
+            round % 3 == 1 ? 65 + rand() % 200 : 1 + rand() % MAX_NEEDLE;
+    make_input(hay, n, needle, m, rand() % 3);
+    size_t k = brute_force(hay, n, needle, m, expected);
+    assert(is_substring(hay, needle) == (k > 0));
+    struct pattern *p = pattern_compile(needle, m);
+    long long first = k ? (long long)expected[0] : -1;
+    assert(pattern_find_first(p, hay, n) == first);
+    assert(pattern_count(p, hay, n) == k);
+    assert(pattern_find_all(p, hay, n, found, MAX_HAY + 1) == k);
+    assert(memcmp(found, expected, sizeof(size_t) * k) == 0);
+    if (round % 8 == 0) {
+      struct pattern_stream *s = pattern_stream_create(p);
+      struct offsets o = {found, 0};
+      for (int pos = 0; pos < n;) {
+        int chunk = 1 + rand() % (rand() % 2 ? 8 : 2 * m);
+        if (chunk > n - pos) chunk = n - pos;
+        pattern_stream_feed(s, hay + pos, chunk, record, &o);
+        pos += chunk;
+      }
+      assert(o.len == k);
+      assert(memcmp(found, expected, sizeof(size_t) * k) == 0);
+      pattern_stream_destroy(s);
+    }
+    pattern_destroy(p);
+  }
+}
+
+// test_adversarial() searches 4 MiB of 'a' for needles that make a
+//   naive search take O(nm) time, with and without a match at the end
+static void test_adversarial(void) {
+  size_t n = 1 << 22;
+  char *hay = malloc(n + 1);
+  memset(hay, 'a', n);
+  hay[n] = '\0';
+  static char needle[MAX_NEEDLE + 1];
+  size_t lens[] = {2, 16, 63, 64, 65, 100, 1000, MAX_NEEDLE};
+  clock_t start = clock();
+  for (int k = 0; k < 8; k++) {
+    size_t m = lens[k];
+    // a^(m-1) b, b a^(m-1), and a^(m/2) b a^(m/2 - 1)
+    for (int shape = 0; shape < 3; shape++) {
+      memset(needle, 'a', m);
+      needle[shape == 0 ? m - 1 : shape == 1 ? 0 : m / 2] = 'b';
+      needle[m] = '\0';
+      struct pattern *p = pattern_compile(needle, m);
+      assert(!is_substring(hay, needle));
+      assert(pattern_find_first(p, hay, n) == -1);
+      size_t at = n - m - 7;
+      memcpy(hay + at, needle, m);
+      assert(is_substring(hay, needle));
+      assert(pattern_find_first(p, hay, n) == (long long)at);
+      assert(pattern_count(p, hay, n) == 1);
+      memset(hay + at, 'a', m);
+      pattern_destroy(p);
+    }
+  }
+  // a periodic needle that almost matches everywhere: abbbbbbabbbbbb...
+  // up to the last byte, which is c
+  for (size_t i = 0; i < n; i++) {
+    hay[i] = i % 7 == 0 ? 'a' : 'b';
+  }
+  for (size_t i = 0; i < MAX_NEEDLE; i++) {
+    needle[i] = i % 7 == 0 ? 'a' : 'b';
+  }
+  needle[MAX_NEEDLE - 1] = 'c';
+  needle[MAX_NEEDLE] = '\0';
+  assert(!is_substring(hay, needle));
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+  // a naive search makes about n * m = 8 * 10^9 comparisons for the
+  // longest needles alone
+  assert(seconds < 30);
+  free(hay);
+}
+
+int main(void) {
+  test_random();
+  test_adversarial();
+  puts("OK");
+}
@@ -0,0 +1,130 @@
+// Throughput of a multiqueue against a single priqueue behind a
+// pthread_mutex, for 1, 2, 4, ... threads that each alternate adding an
+// item with a random priority and removing one. Each queue starts with
+// PREFILL items, each run lasts SECONDS and reports the total adds and
+// removes per second of all threads.
+//
+// multiqueue.h and priqueue.h are the header parts at the top of
+// multiqueue_fun.c and priqueue_fun.c. Build with e.g.
+//   gcc -std=c99 -O2 -pthread multiqueue_fun.c priqueue_fun.c
+//       multiqueue_bench.c -o multiqueue_bench
+//   ./multiqueue_bench [max threads]                 (default 64)
+// Scaling can only show on a machine with that many free cores.
+
+#include "multiqueue.h"
+#include "priqueue.h"
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PREFILL (1 << 16)
+#define SECONDS 0.5
+#define MAX_THREADS 64
+
+// a run adds to and removes from either mq or locked (under lock)
+struct run {
+  struct multiqueue *mq;
+  struct priqueue *locked;
+  pthread_mutex_t lock;
+  int stop;
+};
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r >> 8;
+}
+
+struct worker {
+  pthread_t thread;
+  struct run *run;
+  unsigned seed;
+  long ops;
+};
+
+// work(arg) adds and removes items until the run stops
+static void *work(void *arg) {
+  struct worker *w = arg;
+  struct run *run = w->run;
+  long sum = 0;
+  while (!__atomic_load_n(&run->stop, __ATOMIC_RELAXED)) {
+    for (int n = 0; n < 128; n++) {
+      int priority = next_random(&w->seed);
+      int item = 0;
+      if (run->mq) {
+        multiqueue_add(run->mq, n, priority);
+        multiqueue_remove(run->mq, &item);
+      } else {
+        pthread_mutex_lock(&run->lock);
+        priqueue_add(run->locked, n, priority);
+        item = priqueue_remove(run->locked);
+        pthread_mutex_unlock(&run->lock);
+      }
+      sum += item;
+    }
+    w->ops += 256;
+  }
+  return (void *)sum;
+}
+
+// measure(run, threads) runs threads worker threads on run for SECONDS
+//   and prints their throughput
+static void measure(struct run *run, int threads) {
+  struct worker w[MAX_THREADS];
+  run->stop = 0;
+  double start = now();
+  for (int i = 0; i < threads; i++) {
+    w[i].run = run;
+    w[i].seed = i * 7919 + 1;
+    w[i].ops = 0;
+    pthread_create(&w[i].thread, NULL, work, &w[i]);
+  }
+  while (now() - start < SECONDS) {
+    struct timespec ts = {0, 10000000};
+    nanosleep(&ts, NULL);
+  }
+  __atomic_store_n(&run->stop, 1, __ATOMIC_RELAXED);
+  long ops = 0;
+  for (int i = 0; i < threads; i++) {
+    pthread_join(w[i].thread, NULL);
+    ops += w[i].ops;
+  }
+  double elapsed = now() - start;
+  printf("%-10s %7d %12.2f\n", run->mq ? "multiqueue" : "mutex",
+         threads, ops / elapsed / 1e6);
+}
+
+int main(int argc, char **argv) {
+  int max = argc > 1 ? atoi(argv[1]) : MAX_THREADS;
+  if (max < 1) max = 1;
+  if (max > MAX_THREADS) max = MAX_THREADS;
+  printf("%-10s %7s %12s\n", "queue", "threads", "Mops/s");
+  for (int threads = 1; threads <= max; threads *= 2) {
+    // the multiqueue is sized for the threads that use it
+    struct run multi = {.mq = multiqueue_create(threads, 2)};
+    struct run locked = {.locked = priqueue_create()};
+    pthread_mutex_init(&locked.lock, NULL);
+    unsigned seed = 12345;
+    for (int n = 0; n < PREFILL; n++) {
+      int priority = next_random(&seed);
+      multiqueue_add(multi.mq, n, priority);
+      priqueue_add(locked.locked, n, priority);
+    }
+    measure(&multi, threads);
+    measure(&locked, threads);
+    pthread_mutex_destroy(&locked.lock);
+    priqueue_destroy(locked.locked);
+    multiqueue_destroy(multi.mq);
+  }
+}
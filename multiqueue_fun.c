@@ -0,0 +1,215 @@
+#include <stdbool.h>
+#multiqueue.h
+// A multiqueue is a priority queue that many threads can add to and
+// remove from at the same time. It is made of several priqueues
+// ("shards"), each behind it's own lock:
+//   - multiqueue_add puts the item in a random shard that is not locked
+//   - multiqueue_remove looks at the front priorities of two random
+//     shards and removes from the better one ("power of two choices")
+//
+// Because of this, multiqueue_remove is relaxed: it may return an item
+// that is not the one with the maximum priority. With s shards, the
+// rank of the returned item (0 for the maximum) is O(s) in expectation
+// and O(slogs) with high probability (Alistarh, Kopinsky, Li and
+// Nadiradze, "The Power of Choice in Priority Scheduling", 2017).
+// multiqueue_remove_strict always returns an item with the maximum
+// priority, at the cost of locking every shard.
+
+struct multiqueue;
+
+// NOTES: All of the following functions REQUIRE:
+//        pointers to a multiqueue (e.g., mq) are valid (not NULL)
+//
+//       For times, n is the number of items and s the number of shards
+
+// multiqueue_create(threads, c) returns a pointer to a new (empty)
+//   multiqueue with c * threads shards, for use by up to threads threads
+//   at the same time (c = 2 is a good default)
+// requires: threads >= 1, c >= 1
+// effects: allocates memory (caller must call multiqueue_destroy)
+// time: O(s)
+struct multiqueue *multiqueue_create(int threads, int c);
+
+// multiqueue_destroy(mq) frees all dynamically allocated memory
+// requires: no other thread is using mq
+// effects: the memory at mq is invalid (freed)
+// time: O(s)
+void multiqueue_destroy(struct multiqueue *mq);
+
+// multiqueue_length(mq) determines how many items are in mq; while other
+//   threads are changing mq the result may already be out of date
+// time: O(s)
+int multiqueue_length(struct multiqueue *mq);
+
+// multiqueue_add(mq, item, priority) inserts item with priority into mq
+// effects: modifies mq
+// time: O(logn), plus waiting while all tried shards are locked
+void multiqueue_add(struct multiqueue *mq, int item, int priority);
+
+// multiqueue_remove(mq, item) removes an item with a high priority (see
+//   above) from mq, stores it in *item and returns true, or returns
+//   false if mq is empty
+// effects: modifies mq and *item
+// time: O(logn + s), plus waiting while the chosen shards are locked
+bool multiqueue_remove(struct multiqueue *mq, int *item);
+
+// multiqueue_remove_strict(mq, item) is multiqueue_remove, but always
+//   removes an item with the maximum priority
+// effects: modifies mq and *item
+// time: O(logn + s), plus waiting for every shard lock
+bool multiqueue_remove_strict(struct multiqueue *mq, int *item);
+
+
+
+#include "multiqueue.h"
+#include "priqueue.h"
+#define _POSIX_C_SOURCE 200809L   // posix_memalign
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+
+// top is the front priority of pq, or EMPTY if pq is empty; it is
+// written under lock but read without it to choose a shard
+struct shard {
+  pthread_mutex_t lock __attribute__((aligned(64)));
+  struct priqueue *pq;
+  long long top;
+  int len;
+};
+
+static const long long EMPTY = LLONG_MIN;
+
+struct multiqueue {
+  int nshards;
+  struct shard *shards;
+};
+
+// seed gives each thread a different random sequence
+static unsigned seed = 0;
+static __thread unsigned rng = 0;
+
+// random_shard(mq) produces the index of a random shard of mq
+// (xorshift, one state per thread)
+// time: O(1)
+static int random_shard(struct multiqueue *mq) {
+  if (rng == 0) {
+    rng = __atomic_add_fetch(&seed, 0x9e3779b9u, __ATOMIC_RELAXED) | 1;
+  }
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng % mq->nshards;
+}
+
+// shard_top(sh) produces the front priority of sh as last published
+// time: O(1)
+static long long shard_top(struct shard *sh) {
+  return __atomic_load_n(&sh->top, __ATOMIC_RELAXED);
+}
+
+// shard_publish(sh) records the front priority and length of sh
+// requires: the caller holds sh->lock
+// effects: modifies sh
+// time: O(1)
+static void shard_publish(struct shard *sh) {
+  int len = priqueue_length(sh->pq);
+  long long top = len ? priqueue_front_priority(sh->pq) : EMPTY;
+  __atomic_store_n(&sh->top, top, __ATOMIC_RELAXED);
+  __atomic_store_n(&sh->len, len, __ATOMIC_RELAXED);
+}
+
+struct multiqueue *multiqueue_create(int threads, int c) {
+  struct multiqueue *new = malloc(sizeof(struct multiqueue));
+  new->nshards = threads * c;
+  void *shards;
+  if (posix_memalign(&shards, 64, sizeof(struct shard) * new->nshards) != 0) {
+    shards = NULL;
+  }
+  new->shards = shards;
+  for (int i = 0; i < new->nshards; i++) {
+    pthread_mutex_init(&new->shards[i].lock, NULL);
+    new->shards[i].pq = priqueue_create();
+    new->shards[i].top = EMPTY;
+    new->shards[i].len = 0;
+  }
+  return new;
+}
+
+void multiqueue_destroy(struct multiqueue *mq) {
+  for (int i = 0; i < mq->nshards; i++) {
+    pthread_mutex_destroy(&mq->shards[i].lock);
+    priqueue_destroy(mq->shards[i].pq);
+  }
+  free(mq->shards);
+  free(mq);
+}
+
+int multiqueue_length(struct multiqueue *mq) {
+  int len = 0;
+  for (int i = 0; i < mq->nshards; i++) {
+    len += __atomic_load_n(&mq->shards[i].len, __ATOMIC_RELAXED);
+  }
+  return len;
+}
+
+void multiqueue_add(struct multiqueue *mq, int item, int priority) {
+  struct shard *sh = &mq->shards[random_shard(mq)];
+  while (pthread_mutex_trylock(&sh->lock) != 0) {
+    sh = &mq->shards[random_shard(mq)];
+  }
+  priqueue_add(sh->pq, item, priority);
+  shard_publish(sh);
+  pthread_mutex_unlock(&sh->lock);
+}
+
+// all_empty(mq) determines if every shard of mq was empty when looked at
+// time: O(s)
+static bool all_empty(struct multiqueue *mq) {
+  for (int i = 0; i < mq->nshards; i++) {
+    if (shard_top(&mq->shards[i]) != EMPTY) return false;
+  }
+  return true;
+}
+
+bool multiqueue_remove(struct multiqueue *mq, int *item) {
+  while (1) {
+    struct shard *a = &mq->shards[random_shard(mq)];
+    struct shard *b = &mq->shards[random_shard(mq)];
+    struct shard *sh = shard_top(a) >= shard_top(b) ? a : b;
+    if (shard_top(sh) == EMPTY) {
+      if (all_empty(mq)) return false;
+      continue;
+    }
+    if (pthread_mutex_trylock(&sh->lock) != 0) continue;
+    bool found = priqueue_length(sh->pq) > 0;
+    if (found) {
+      *item = priqueue_remove(sh->pq);
+      shard_publish(sh);
+    }
+    pthread_mutex_unlock(&sh->lock);
+    if (found) return true;
+  }
+}
+
+bool multiqueue_remove_strict(struct multiqueue *mq, int *item) {
+  for (int i = 0; i < mq->nshards; i++) {
+    pthread_mutex_lock(&mq->shards[i].lock);
+  }
+  struct shard *best = NULL;
+  for (int i = 0; i < mq->nshards; i++) {
+    struct shard *sh = &mq->shards[i];
+    if (priqueue_length(sh->pq) > 0 &&
+        (best == NULL || priqueue_front_priority(sh->pq) >
+                         priqueue_front_priority(best->pq))) {
+      best = sh;
+    }
+  }
+  if (best) {
+    *item = priqueue_remove(best->pq);
+    shard_publish(best);
+  }
+  for (int i = mq->nshards - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&mq->shards[i].lock);
+  }
+  return best != NULL;
+}
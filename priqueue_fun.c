@@ -15,6 +15,38 @@ struct priqueue;
 // time: O(1)
 struct priqueue *priqueue_create(void);
 
+// priqueue_create_monotone() returns a pointer to a new (empty) priqueue
+//   for monotone use: every priority added must be no higher than the
+//   priority of the last item removed (as in Dijkstra-style searches
+//   or time-ordered events, with priorities counting down)
+// note: it is stored as a radix heap, so priqueue_add is O(1) and
+//   priqueue_remove is O(logC) amortized, where C is the difference
+//   between the highest and lowest priority in the priqueue
+//   priqueue_add returns -1 (there are no handles), so priqueue_update
+//   and priqueue_delete can not be used
+// effects: allocates memory (caller must call priqueue_destroy)
+// time: O(1)
+struct priqueue *priqueue_create_monotone(void);
+
+// priqueue_create_meldable() returns a pointer to a new (empty) priqueue
+//   that can be melded with priqueue_meld
+// note: it is stored as a pairing heap, so priqueue_add is O(1) and
+//   priqueue_remove is O(logn) amortized
+//   priqueue_add returns -1 (there are no handles), so priqueue_update
+//   and priqueue_delete can not be used
+// effects: allocates memory (caller must call priqueue_destroy)
+// time: O(1)
+struct priqueue *priqueue_create_meldable(void);
+
+// priqueue_create_from_arrays(items, pris, n) returns a pointer to a new
+//   priqueue with the n items of items, where items[i] has priority
+//   pris[i]; the handles are 0 ... n - 1 in the same order
+// requires: items and pris are valid, n >= 0
+// effects: allocates memory (caller must call priqueue_destroy)
+// time: O(n)
+struct priqueue *priqueue_create_from_arrays(const int *items,
+                                             const int *pris, int n);
+
 // priqueue_destroy(pq) frees all dynamically allocated memory 
 // effects: the memory at pq is invalid (freed)
 // time: O(1)
@@ -25,9 +57,57 @@ void priqueue_destroy(struct priqueue *pq);
 int priqueue_length(const struct priqueue *pq);
 
 // priqueue_add(pq, item, priority) inserts item with priority into pq
+//   and returns a handle (>= 0) for it, which stays valid until the
+//   item is removed and may then be reused for a later item
 // effects: modifies pq
 // time: O(logn)
-void priqueue_add(struct priqueue *pq, int item, int priority);
+int priqueue_add(struct priqueue *pq, int item, int priority);
+
+// priqueue_reserve(pq, n) makes room for pq to hold n items without
+//   growing again
+// effects: modifies pq
+// time: O(n)
+void priqueue_reserve(struct priqueue *pq, int n);
+
+// priqueue_add_batch(pq, items, pris, n, handles) inserts the n items of
+//   items, where items[i] has priority pris[i], and stores the handle
+//   of items[i] in handles[i] (unless handles is NULL)
+// requires: items and pris are valid, n >= 0
+//           handles is NULL or has room for n handles
+// effects: modifies pq (and handles)
+// time: O(min(n + m, nlog(n + m))), where m is the length of pq before
+void priqueue_add_batch(struct priqueue *pq, const int *items,
+                        const int *pris, int n, int *handles);
+
+// priqueue_remove_k(pq, k, out) removes the k items with the highest
+//   priorities from pq and stores them in out, highest first
+// requires: 0 <= k <= priqueue_length(pq), out has room for k items
+// effects: modifies pq and out
+// time: O(klogn)
+void priqueue_remove_k(struct priqueue *pq, int k, int *out);
+
+// priqueue_meld(pq, other) moves every item of other into pq, leaving
+//   other empty
+// requires: pq and other were made by priqueue_create_meldable
+//           pq and other are not the same priqueue
+// effects: modifies pq and other
+// time: O(1)
+void priqueue_meld(struct priqueue *pq, struct priqueue *other);
+
+// priqueue_update(pq, handle, priority) changes the priority of the
+//   item with the given handle to priority
+// requires: handle is valid for pq
+// effects: modifies pq
+// time: O(logn), but O(n) for the first update or delete of pq
+void priqueue_update(struct priqueue *pq, int handle, int priority);
+
+// priqueue_delete(pq, handle) removes and returns the item with the
+//   given handle
+// requires: handle is valid for pq
+// effects: modifies pq
+//          handle is no longer valid
+// time: O(logn), but O(n) for the first update or delete of pq
+int priqueue_delete(struct priqueue *pq, int handle);
 
 // priqueue_front(pq) returns the item with the highest priority
 //   If there are multiple items with the same priority, 
@@ -36,6 +116,12 @@ void priqueue_add(struct priqueue *pq, int item, int priority);
 // time : O(1)
 int priqueue_front(const struct priqueue *pq);
 
+// priqueue_front_priority(pq) returns the priority of the item returned
+//   by priqueue_front
+// requires: pq is not empty
+// time : O(1)
+int priqueue_front_priority(const struct priqueue *pq);
+
 // priqueue_remove(pq) removes and returns the item with the maximum 
 //   priority in pq.
 //   If there are multiple items with the same priority, 
@@ -50,13 +136,16 @@ int priqueue_remove(struct priqueue *pq);
 
 // priqueue_print(pq) prints pq
 // effects: displays output
-// example: It prints in the order it is stored in the array. 
+// example: It prints in the order it is stored in the array
+//   (a binary heap, unless built with PRIQUEUE_ARITY 4 or 8, when each
+//   node has that many children instead).
 //   For example, if the heap is currently
 //             (1,99)
 //             /    \
 //         (5,20)  (2,30)
 //   then it will be printed as "[(1:99),(5:20),(2:30)]\n"
 //   where each node is printed as (item:priority).
+//   A meldable priqueue prints it's tree in preorder instead.
 //   if empty, it prints as "[empty]\n"
 // time: O(n)
 void priqueue_print(const struct priqueue *pq);
@@ -64,46 +153,457 @@ void priqueue_print(const struct priqueue *pq);
 
 
 #include "priqueue.h"
+#define _POSIX_C_SOURCE 200809L   // posix_memalign
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <assert.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
+// PRIQUEUE_ARITY is the number of children of each node of the heap
+// (2, 4 or 8). It is 2 unless configured (e.g., -DPRIQUEUE_ARITY=4), so
+// priqueue_print shows a binary heap; a wider heap is shallower, and with
+// the layout below the children of a node share one cache line.
+#ifndef PRIQUEUE_ARITY
+#define PRIQUEUE_ARITY 2
+#endif
+
+// an entry keeps a priority next to the handle of it's item, so
+// comparing and moving an entry touches one cache line
+struct entry {
+  int pri;
+  int handle;
+};
+
+// a handle indexes a slot that holds the item and where it's entry is
+// in the heap; the slot of an unused handle holds the next unused one.
+// The position of a handle can not live in it's entry, which is what
+// moves, so keeping it costs a store to a second array (in handle
+// order, so usually another cache line) for every entry a sift moves:
+// about a tenth of the time of add and remove, and a third with
+// PRIQUEUE_ARITY 8. Most queues never use their handles, so positions
+// are only recorded once pq->tracked is set by the first
+// priqueue_update or priqueue_delete.
+struct slot {
+  int item;
+  int pos;
+};
+
+// heap[0] is the root and the children of heap[i] are
+// heap[PRIQUEUE_ARITY * i + 1 ... PRIQUEUE_ARITY * i + PRIQUEUE_ARITY];
+// heap points ENTRIES_PER_LINE - 1 entries into the 64 byte aligned
+// block, so heap[1] (and so every group of children) starts a line
+// slots has room for maxlen handles; the handles below nslots that
+// are not in use are linked from freeslot (-1 if there are none), and
+// the pos of the handles in use is right only if tracked
+// radix is NULL unless pq was made by priqueue_create_monotone, and
+// then it holds all of the items instead of heap; pairing is the same
+// for priqueue_create_meldable
 struct priqueue {
   int len;
   int maxlen;
-  int *value;
-  int *pri;
+  struct entry *heap;
+  struct entry *block;
+  struct slot *slots;
+  int nslots;
+  int freeslot;
+  bool tracked;
+  struct radixheap *radix;
+  struct pairingheap *pairing;
+};
+
+// a radix heap stores keys that count up as priorities count down; all
+// keys are >= last (the key of the last item removed) and bucket b > 0
+// holds the keys whose highest bit that differs from last is bit b - 1
+#define BUCKETS 33
+
+struct radixentry {
+  unsigned key;
+  int item;
+};
+
+// min is the position of the smallest key in entries (if len > 0)
+struct bucket {
+  struct radixentry *entries;
+  int len;
+  int maxlen;
+  int min;
+};
+
+struct radixheap {
+  unsigned last;
+  struct bucket buckets[BUCKETS];
 };
 
-// my_swap(pq,pos1,pos2) swaps the two elements with index pos1 and pos2 
-// in the array pq->value and pq->pri
-// effect: modifies pq
-// require: 0 <= pos1,pos2 < pq->len;
+// a pairing heap is a tree in which every node has a priority no higher
+// than it's parent; the children of a node are linked through sibling,
+// and so are the unused nodes of free
+struct pairnode {
+  int pri;
+  int item;
+  struct pairnode *child;
+  struct pairnode *sibling;
+};
+
+// nodes are carved out of slabs owned by the heap; melding hands every
+// slab (and unused node) of one heap to the other
+struct pairslab {
+  struct pairslab *next;
+  int len;
+  int used;
+  struct pairnode nodes[];
+};
+
+// nodes are carved from the first slab of slabs
+// lastslab and freetail are the last of their lists (NULL if empty)
+struct pairingheap {
+  struct pairnode *root;
+  struct pairslab *slabs;
+  struct pairslab *lastslab;
+  struct pairnode *free;
+  struct pairnode *freetail;
+};
+
+// slabs start with MIN_SLAB nodes and double up to MAX_SLAB nodes
+static const int MIN_SLAB = 64;
+static const int MAX_SLAB = 65536;
+
+#define ENTRIES_PER_LINE (64 / (int)sizeof(struct entry))
+
+// heap_alloc(pq,maxlen) moves the heap of pq to a new block with room
+// for maxlen entries
+// effects: modifies pq
+// time: O(n)
+static void heap_alloc(struct priqueue *pq, int maxlen) {
+  size_t bytes = sizeof(struct entry) * (maxlen + ENTRIES_PER_LINE - 1);
+  void *aligned;
+  if (posix_memalign(&aligned, 64, bytes) != 0) aligned = NULL;
+  struct entry *block = aligned;
+  struct entry *heap = block + ENTRIES_PER_LINE - 1;
+  if (pq->len > 0) memcpy(heap, pq->heap, sizeof(struct entry) * pq->len);
+  free(pq->block);
+  pq->block = block;
+  pq->heap = heap;
+  pq->maxlen = maxlen;
+  pq->slots = realloc(pq->slots, sizeof(struct slot) * maxlen);
+}
+
+// heap_set(pq,pos,e) stores e at heap[pos] and (if pq is tracked)
+// records pos in the slot of it's handle
+// effects: modifies pq
+// time: O(1)
+static void heap_set(struct priqueue *pq, int pos, struct entry e) {
+  pq->heap[pos] = e;
+  if (pq->tracked) pq->slots[e.handle].pos = pos;
+}
+
+// heap_track(pq) records the position of every entry of pq in the slot
+// of it's handle, and keeps doing so from now on
+// effects: modifies pq
+// time: O(n) the first time, then O(1)
+static void heap_track(struct priqueue *pq) {
+  if (pq->tracked) return;
+  for (int pos = 0; pos < pq->len; pos++) {
+    pq->slots[pq->heap[pos].handle].pos = pos;
+  }
+  pq->tracked = true;
+}
+
+// sift_up(pq,pos,e) stores e in the heap of pq at the hole pos, after
+// moving the hole up past every parent with a lower priority than e
+// effects: modifies pq
+// time: O(logn)
+static void sift_up(struct priqueue *pq, int pos, struct entry e) {
+  struct entry *heap = pq->heap;
+  while (pos > 0) {
+    int parent = (pos - 1) / PRIQUEUE_ARITY;
+    if (heap[parent].pri >= e.pri) break;
+    heap_set(pq, pos, heap[parent]);
+    pos = parent;
+  }
+  heap_set(pq, pos, e);
+}
+
+// max_child(pq,first) produces the index of the first of the children
+// heap[first ...] of a node with the highest priority
+// requires: first < pq->len
+// time: O(PRIQUEUE_ARITY)
+static int max_child(const struct priqueue *pq, int first) {
+  const struct entry *heap = pq->heap;
+#if PRIQUEUE_ARITY == 8 && defined(__AVX2__)
+  if (first + 8 <= pq->len) {
+    // gather the 8 priorities (even lanes) into one vector
+    const __m256i evens = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i lo = _mm256_loadu_si256((const __m256i *)&heap[first]);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)&heap[first + 4]);
+    lo = _mm256_permutevar8x32_epi32(lo, evens);
+    hi = _mm256_permutevar8x32_epi32(hi, evens);
+    __m256i pri = _mm256_permute2x128_si256(lo, hi, 0x20);
+    __m256i max = _mm256_max_epi32(pri, _mm256_shuffle_epi32(pri, 0x4e));
+    max = _mm256_max_epi32(max, _mm256_shuffle_epi32(max, 0xb1));
+    max = _mm256_max_epi32(max, _mm256_permute2x128_si256(max, max, 1));
+    int mask = _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(pri, max)));
+    return first + __builtin_ctz(mask);
+  }
+#endif
+  int last = first + PRIQUEUE_ARITY;
+  if (last > pq->len) last = pq->len;
+  int best = first;
+  for (int i = first + 1; i < last; i++) {
+    if (heap[i].pri > heap[best].pri) best = i;
+  }
+  return best;
+}
+
+// sift_down(pq,pos,e) stores e in the heap of pq at the hole pos, after
+// moving the hole down past every child with a higher priority than e
+// effects: modifies pq
+// time: O(logn)
+static void sift_down(struct priqueue *pq, int pos, struct entry e) {
+  struct entry *heap = pq->heap;
+  while (1) {
+    int first = PRIQUEUE_ARITY * pos + 1;
+    if (first >= pq->len) break;
+    int child = max_child(pq, first);
+    if (heap[child].pri <= e.pri) break;
+    heap_set(pq, pos, heap[child]);
+    pos = child;
+  }
+  heap_set(pq, pos, e);
+}
+
+// radix_key(priority) produces the radix heap key of priority, so that
+// higher priorities have smaller keys
+// time: O(1)
+static unsigned radix_key(int priority) {
+  return (unsigned)INT_MAX - (unsigned)priority;
+}
+
+// radix_priority(key) produces the priority with the radix heap key key
+// time: O(1)
+static int radix_priority(unsigned key) {
+  return (int)((unsigned)INT_MAX - key);
+}
+
+// radix_bucket(rh,key) produces the bucket of rh that key belongs in
 // time: O(1)
-void my_swap(struct priqueue *pq, int pos1, int pos2) {
-  int temp0 = pq->value[pos1];
-  int temp1 = pq->pri[pos1];
-  pq->value[pos1] = pq->value[pos2];
-  pq->pri[pos1] = pq->pri[pos2];
-  pq->value[pos2] = temp0;
-  pq->pri[pos2] = temp1;
+static int radix_bucket(const struct radixheap *rh, unsigned key) {
+  if (key == rh->last) return 0;
+  return 32 - __builtin_clz(key ^ rh->last);
 }
 
+// radix_put(rh,e) stores e in it's bucket of rh
+// effects: modifies rh
+// time: O(1) amortized
+static void radix_put(struct radixheap *rh, struct radixentry e) {
+  struct bucket *b = &rh->buckets[radix_bucket(rh, e.key)];
+  if (b->len == b->maxlen) {
+    b->maxlen = b->maxlen ? 2 * b->maxlen : 4;
+    b->entries = realloc(b->entries, sizeof(struct radixentry) * b->maxlen);
+  }
+  if (b->len == 0 || e.key < b->entries[b->min].key) b->min = b->len;
+  b->entries[b->len++] = e;
+}
 
+// radix_first(rh) produces the first bucket of rh that is not empty
+// requires: rh is not empty
+// time: O(1)
+static const struct bucket *radix_first(const struct radixheap *rh) {
+  int i = 0;
+  while (rh->buckets[i].len == 0) i++;
+  return &rh->buckets[i];
+}
 
+// radix_take(rh) removes the entry with the smallest key from rh and
+// produces it; the rest of it's bucket moves to lower buckets
+// requires: rh is not empty
+// effects: modifies rh
+// time: O(logC) amortized
+static struct radixentry radix_take(struct radixheap *rh) {
+  struct bucket *b = &rh->buckets[0];
+  if (b->len == 0) {
+    struct bucket *first = (struct bucket *)radix_first(rh);
+    int len = first->len;
+    rh->last = first->entries[first->min].key;
+    first->len = 0;
+    // every entry of first now shares more leading bits with last
+    for (int i = 0; i < len; i++) {
+      radix_put(rh, first->entries[i]);
+    }
+  }
+  return b->entries[--b->len];
+}
 
+// pairing_slab_add(ph,len) adds a new slab with room for len nodes to ph
+// and makes it the one nodes are carved from
+// effects: allocates memory (freed by priqueue_destroy)
+// time: O(1)
+static void pairing_slab_add(struct pairingheap *ph, int len) {
+  struct pairslab *new = malloc(sizeof(struct pairslab) +
+                                sizeof(struct pairnode) * len);
+  new->next = ph->slabs;
+  new->len = len;
+  new->used = 0;
+  ph->slabs = new;
+  if (ph->lastslab == NULL) ph->lastslab = new;
+}
+
+// pairing_node(ph,item,priority) produces an unused node of ph holding
+// item with priority
+// effects: may allocate a new slab
+// time: O(1) amortized
+static struct pairnode *pairing_node(struct pairingheap *ph, int item,
+                                     int priority) {
+  struct pairnode *node = ph->free;
+  if (node) {
+    ph->free = node->sibling;
+    if (ph->free == NULL) ph->freetail = NULL;
+  } else {
+    struct pairslab *slab = ph->slabs;
+    if (slab == NULL || slab->used == slab->len) {
+      int len = MIN_SLAB;
+      if (slab) len = slab->len < MAX_SLAB / 2 ? 2 * slab->len : MAX_SLAB;
+      pairing_slab_add(ph, len);
+      slab = ph->slabs;
+    }
+    node = &slab->nodes[slab->used++];
+  }
+  node->pri = priority;
+  node->item = item;
+  node->child = NULL;
+  node->sibling = NULL;
+  return node;
+}
+
+// pairing_link(a,b) makes the root with the lower priority of a and b a
+// child of the other, and produces the root of the result
+// requires: a and b are roots with no siblings
+// effects: modifies a and b
+// time: O(1)
+static struct pairnode *pairing_link(struct pairnode *a, struct pairnode *b) {
+  if (b->pri > a->pri) {
+    struct pairnode *t = a;
+    a = b;
+    b = t;
+  }
+  b->sibling = a->child;
+  a->child = b;
+  return a;
+}
+
+// pairing_merge_pairs(first) links the list of siblings starting at
+// first into one tree and produces it's root: first in pairs from left
+// to right, then the pairs from right to left
+// effects: modifies the nodes of the list
+// time: O(m), where m is the length of the list
+static struct pairnode *pairing_merge_pairs(struct pairnode *first) {
+  struct pairnode *pairs = NULL;  // linked pairs, last pair first
+  while (first) {
+    struct pairnode *a = first;
+    struct pairnode *b = a->sibling;
+    if (b == NULL) {
+      a->sibling = pairs;
+      pairs = a;
+      break;
+    }
+    first = b->sibling;
+    a->sibling = NULL;
+    b->sibling = NULL;
+    a = pairing_link(a, b);
+    a->sibling = pairs;
+    pairs = a;
+  }
+  struct pairnode *root = NULL;
+  while (pairs) {
+    struct pairnode *next = pairs->sibling;
+    pairs->sibling = NULL;
+    root = root ? pairing_link(root, pairs) : pairs;
+    pairs = next;
+  }
+  return root;
+}
+
+// pairing_take(ph) removes the root of ph and produces it's item
+// requires: ph is not empty
+// effects: modifies ph
+// time: O(logn) amortized
+static int pairing_take(struct pairingheap *ph) {
+  struct pairnode *root = ph->root;
+  ph->root = pairing_merge_pairs(root->child);
+  root->sibling = ph->free;
+  if (ph->free == NULL) ph->freetail = root;
+  ph->free = root;
+  return root->item;
+}
 
 struct priqueue *priqueue_create(void) {
   struct priqueue *new = malloc( sizeof(struct priqueue) );
   new->len = 0;
-  new->maxlen = 1;
-  new->value = malloc( sizeof(int) * new->maxlen );
-  new->pri = malloc( sizeof(int) * new->maxlen );
+  new->heap = NULL;
+  new->block = NULL;
+  new->slots = NULL;
+  new->nslots = 0;
+  new->freeslot = -1;
+  new->tracked = false;
+  new->radix = NULL;
+  new->pairing = NULL;
+  heap_alloc(new, 1);
+  return new;
+}
+
+struct priqueue *priqueue_create_monotone(void) {
+  struct priqueue *new = priqueue_create();
+  new->radix = malloc(sizeof(struct radixheap));
+  new->radix->last = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    new->radix->buckets[i].entries = NULL;
+    new->radix->buckets[i].len = 0;
+    new->radix->buckets[i].maxlen = 0;
+    new->radix->buckets[i].min = 0;
+  }
+  return new;
+}
+
+struct priqueue *priqueue_create_meldable(void) {
+  struct priqueue *new = priqueue_create();
+  new->pairing = malloc(sizeof(struct pairingheap));
+  new->pairing->root = NULL;
+  new->pairing->slabs = NULL;
+  new->pairing->lastslab = NULL;
+  new->pairing->free = NULL;
+  new->pairing->freetail = NULL;
+  return new;
+}
+
+struct priqueue *priqueue_create_from_arrays(const int *items,
+                                             const int *pris, int n) {
+  struct priqueue *new = priqueue_create();
+  priqueue_add_batch(new, items, pris, n, NULL);
   return new;
 }
 
 void priqueue_destroy(struct priqueue *pq) {
-  free(pq->value);
-  free(pq->pri);
+  if (pq->radix) {
+    for (int i = 0; i < BUCKETS; i++) {
+      free(pq->radix->buckets[i].entries);
+    }
+    free(pq->radix);
+  }
+  if (pq->pairing) {
+    while (pq->pairing->slabs) {
+      struct pairslab *next = pq->pairing->slabs->next;
+      free(pq->pairing->slabs);
+      pq->pairing->slabs = next;
+    }
+    free(pq->pairing);
+  }
+  free(pq->block);
+  free(pq->slots);
   free(pq);
 }
 
@@ -115,66 +615,205 @@ int priqueue_length(const struct priqueue *pq) {
   }
 }
 
-void priqueue_add(struct priqueue *pq, int item, int priority) {
-  if (pq->len == pq->maxlen) {
-    pq->maxlen *= 2;
-    pq->value = realloc(pq->value, sizeof(int) * pq->maxlen);
-    pq->pri = realloc(pq->pri, sizeof(int) * pq->maxlen);
+// slot_alloc(pq,item) produces an unused handle of pq for item
+// requires: pq has fewer than maxlen handles in use
+// effects: modifies pq
+// time: O(1)
+static int slot_alloc(struct priqueue *pq, int item) {
+  int handle = pq->freeslot;
+  if (handle >= 0) {
+    pq->freeslot = pq->slots[handle].pos;
+  } else {
+    handle = pq->nslots++;
   }
-  pq->value[pq->len] = item;
-  pq->pri[pq->len] = priority;
+  pq->slots[handle].item = item;
+  return handle;
+}
+
+// slot_free(pq,handle) gives handle back to pq for reuse
+// effects: modifies pq
+// time: O(1)
+static void slot_free(struct priqueue *pq, int handle) {
+  pq->slots[handle].pos = pq->freeslot;
+  pq->freeslot = handle;
+}
 
-  int pos = pq->len;
+int priqueue_add(struct priqueue *pq, int item, int priority) {
+  if (pq->radix) {
+    struct radixentry e = {radix_key(priority), item};
+    assert(e.key >= pq->radix->last);
+    radix_put(pq->radix, e);
+    pq->len++;
+    return -1;
+  }
+  if (pq->pairing) {
+    struct pairingheap *ph = pq->pairing;
+    struct pairnode *node = pairing_node(ph, item, priority);
+    ph->root = ph->root ? pairing_link(ph->root, node) : node;
+    pq->len++;
+    return -1;
+  }
+  if (pq->len == pq->maxlen) {
+    heap_alloc(pq, pq->maxlen * 2);
+  }
+  struct entry e = {priority, slot_alloc(pq, item)};
   pq->len++;
+  sift_up(pq, pq->len - 1, e);
+  return e.handle;
+}
 
-  while (1) {
-    if (pos == 0) break;
-    if ( pq->pri[(pos - 1) / 2] < pq->pri[pos] ) {
-      my_swap(pq,pos,(pos-1)/2);
-      pos = (pos-1) / 2;
+void priqueue_reserve(struct priqueue *pq, int n) {
+  if (pq->pairing) {
+    struct pairslab *slab = pq->pairing->slabs;
+    int room = slab ? slab->len - slab->used : 0;
+    if (n - pq->len > room) pairing_slab_add(pq->pairing, n - pq->len);
+  } else if (pq->radix == NULL && n > pq->maxlen) {
+    heap_alloc(pq, n);
+  }
+}
+
+// heapify(pq) restores the heap order of all of pq from the bottom up
+// (Floyd's method)
+// effects: modifies pq
+// time: O(n)
+static void heapify(struct priqueue *pq) {
+  for (int pos = (pq->len - 2) / PRIQUEUE_ARITY; pos >= 0; pos--) {
+    sift_down(pq, pos, pq->heap[pos]);
+  }
+}
+
+void priqueue_add_batch(struct priqueue *pq, const int *items,
+                        const int *pris, int n, int *handles) {
+  if (pq->radix || pq->pairing) {
+    for (int i = 0; i < n; i++) {
+      int handle = priqueue_add(pq, items[i], pris[i]);
+      if (handles) handles[i] = handle;
+    }
+    return;
+  }
+  int old = pq->len;
+  int maxlen = pq->maxlen;
+  while (maxlen < old + n) maxlen *= 2;
+  priqueue_reserve(pq, maxlen);
+  // sifting each new item up costs about n levels of log(old + n) each
+  long long sift_cost = 0;
+  for (int len = old + n; len > 0; len /= PRIQUEUE_ARITY) {
+    sift_cost += n;
+  }
+  bool rebuild = sift_cost > old + n;
+  for (int i = 0; i < n; i++) {
+    struct entry e = {pris[i], slot_alloc(pq, items[i])};
+    if (handles) handles[i] = e.handle;
+    pq->len++;
+    if (rebuild) {
+      heap_set(pq, pq->len - 1, e);
     } else {
-      break;
+      sift_up(pq, pq->len - 1, e);
     }
   }
+  if (rebuild) heapify(pq);
+}
+
+void priqueue_remove_k(struct priqueue *pq, int k, int *out) {
+  for (int i = 0; i < k; i++) {
+    out[i] = priqueue_remove(pq);
+  }
+}
+
+void priqueue_meld(struct priqueue *pq, struct priqueue *other) {
+  assert(pq->pairing && other->pairing && pq != other);
+  struct pairingheap *a = pq->pairing;
+  struct pairingheap *b = other->pairing;
+  if (b->root) a->root = a->root ? pairing_link(a->root, b->root) : b->root;
+  // b's slabs go after a's first slab, so a keeps carving from it
+  if (a->slabs == NULL) {
+    a->slabs = b->slabs;
+    a->lastslab = b->lastslab;
+  } else if (b->slabs) {
+    b->lastslab->next = a->slabs->next;
+    if (a->slabs->next == NULL) a->lastslab = b->lastslab;
+    a->slabs->next = b->slabs;
+  }
+  if (b->free) {
+    b->freetail->sibling = a->free;
+    if (a->free == NULL) a->freetail = b->freetail;
+    a->free = b->free;
+  }
+  pq->len += other->len;
+  other->len = 0;
+  b->root = NULL;
+  b->slabs = NULL;
+  b->lastslab = NULL;
+  b->free = NULL;
+  b->freetail = NULL;
 }
 
 int priqueue_front(const struct priqueue *pq) {
-  return pq->value[0];
+  if (pq->radix) {
+    const struct bucket *b = radix_first(pq->radix);
+    return b->entries[b->min].item;
+  }
+  if (pq->pairing) return pq->pairing->root->item;
+  return pq->slots[pq->heap[0].handle].item;
 }
 
-int priqueue_remove(struct priqueue *pq) {
-  int backup = pq->value[0];
-  pq->value[0] = pq->value[pq->len-1];
-  pq->pri[0] = pq->pri[pq->len-1];
-  pq->len--;
+int priqueue_front_priority(const struct priqueue *pq) {
+  if (pq->radix) {
+    const struct bucket *b = radix_first(pq->radix);
+    return radix_priority(b->entries[b->min].key);
+  }
+  if (pq->pairing) return pq->pairing->root->pri;
+  return pq->heap[0].pri;
+}
 
-  int pos = 0;
-  while(1) {
-    if ( (2 * pos + 1) > pq->len-1 ) break;
-    if ( (2 * pos + 2 ) > pq->len-1 ) {
-      if (pq->pri[2 * pos + 1] > pq->pri[pos]) {
-        my_swap(pq,pos,2*pos+1);
-        break;
-      } else {
-        break;
-      }
+// heap_take(pq,pos) removes the entry at heap[pos] and produces it's item
+// requires: 0 <= pos < pq->len
+// effects: modifies pq
+// time: O(logn)
+static int heap_take(struct priqueue *pq, int pos) {
+  struct entry gone = pq->heap[pos];
+  int item = pq->slots[gone.handle].item;
+  slot_free(pq, gone.handle);
+  pq->len--;
+  if (pos < pq->len) {
+    struct entry last = pq->heap[pq->len];
+    if (last.pri > gone.pri) {
+      sift_up(pq, pos, last);
     } else {
-      if ( pq->pri[2 * pos + 1] > pq->pri[pos] \
-         && pq->pri[2 * pos + 1] >= pq->pri[2 * pos + 2]) {
-        my_swap(pq,pos,2*pos+1);
-        pos = 2 * pos + 1;
-      } else {
-        if ( pq->pri[2 * pos + 2] > pq->pri[pos] \
-           && pq->pri[2 * pos + 2] > pq->pri[2 * pos + 1]) {
-          my_swap(pq,pos,2*pos+2);
-          pos = 2 * pos + 2;
-        } else {
-          break;
-        }
-      }
+      sift_down(pq, pos, last);
     }
   }
-  return backup;
+  return item;
+}
+
+int priqueue_remove(struct priqueue *pq) {
+  if (pq->radix) {
+    pq->len--;
+    return radix_take(pq->radix).item;
+  }
+  if (pq->pairing) {
+    pq->len--;
+    return pairing_take(pq->pairing);
+  }
+  return heap_take(pq, 0);
+}
+
+void priqueue_update(struct priqueue *pq, int handle, int priority) {
+  assert(pq->radix == NULL && pq->pairing == NULL);
+  heap_track(pq);
+  int pos = pq->slots[handle].pos;
+  struct entry e = {priority, handle};
+  if (priority > pq->heap[pos].pri) {
+    sift_up(pq, pos, e);
+  } else {
+    sift_down(pq, pos, e);
+  }
+}
+
+int priqueue_delete(struct priqueue *pq, int handle) {
+  assert(pq->radix == NULL && pq->pairing == NULL);
+  heap_track(pq);
+  return heap_take(pq, pq->slots[handle].pos);
 }
 
 
@@ -182,10 +821,35 @@ void priqueue_print(const struct priqueue *pq) {
   printf("[");
   if (pq->len == 0)  {
     printf("empty");
+  } else if (pq->radix) {
+    bool first = true;
+    for (int i = 0; i < BUCKETS; i++) {
+      const struct bucket *b = &pq->radix->buckets[i];
+      for (int j = 0; j < b->len; j++) {
+        if (!first) printf(",");
+        printf("(%d:%d)",b->entries[j].item,radix_priority(b->entries[j].key));
+        first = false;
+      }
+    }
+  } else if (pq->pairing) {
+    // preorder: a node, then it's children, then it's later siblings
+    struct pairnode **stack = malloc(sizeof(struct pairnode *) * pq->len);
+    int top = 0;
+    stack[top++] = pq->pairing->root;
+    bool first = true;
+    while (top > 0) {
+      struct pairnode *node = stack[--top];
+      if (!first) printf(",");
+      printf("(%d:%d)",node->item,node->pri);
+      first = false;
+      if (node->sibling) stack[top++] = node->sibling;
+      if (node->child) stack[top++] = node->child;
+    }
+    free(stack);
   } else {
-    printf("(%d:%d)",pq->value[0],pq->pri[0]);
-    for(int i = 1; i < pq->len; i++) {
-      printf(",(%d:%d)",pq->value[i],pq->pri[i]);
+    for(int i = 0; i < pq->len; i++) {
+      if (i > 0) printf(",");
+      printf("(%d:%d)",pq->slots[pq->heap[i].handle].item,pq->heap[i].pri);
     }
   }
   printf("]\n");
@@ -0,0 +1,135 @@
+// Benchmark of the monotone radix heap against the binary heap on a
+// Dijkstra-like workload: single source shortest paths over a random
+// graph with DEGREE edges per node, where every relaxed edge adds the
+// node again with priority -distance (so priorities only count down)
+// and stale entries are skipped when they are removed. For several
+// ranges of edge weights it prints the time of one search with
+// priqueue_create_monotone and with priqueue_create, and the millions
+// of removes per second of each. Both must find the same distances.
+//
+// priqueue.h is the header part at the top of priqueue_fun.c. Build
+// with e.g.
+//   gcc -std=c99 -O2 priqueue_fun.c priqueue_monotone_bench.c
+//       -o priqueue_monotone_bench
+//   ./priqueue_monotone_bench [nodes]              (default 1000000)
+
+#include "priqueue.h"
+#define _POSIX_C_SOURCE 200809L   // clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <time.h>
+
+#define DEGREE 8
+#define RUNS 3
+
+// a graph stores the edges of node v in to[first[v]] ... to[first[v+1]-1]
+// with the same weights in weight
+struct graph {
+  int nodes;
+  int *first;
+  int *to;
+  int *weight;
+};
+
+// now() produces the time in seconds
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// next_random(r) advances the generator *r and produces a random number
+// effects: modifies *r
+static unsigned next_random(unsigned *r) {
+  *r = *r * 1103515245 + 12345;
+  return *r >> 8;
+}
+
+// make_graph(g, nodes, max_weight) fills g with a random graph of nodes
+//   nodes and DEGREE edges per node, with weights in 1 ... max_weight;
+//   node v has an edge to v + 1, so every node can be reached from 0
+// effects: allocates memory (caller must free the arrays of g)
+static void make_graph(struct graph *g, int nodes, int max_weight) {
+  unsigned r = 42;
+  g->nodes = nodes;
+  g->first = malloc(sizeof(int) * (nodes + 1));
+  g->to = malloc(sizeof(int) * nodes * DEGREE);
+  g->weight = malloc(sizeof(int) * nodes * DEGREE);
+  for (int v = 0; v < nodes; v++) {
+    g->first[v] = v * DEGREE;
+    for (int e = v * DEGREE; e < (v + 1) * DEGREE; e++) {
+      int u = next_random(&r) % nodes;
+      g->to[e] = e == v * DEGREE ? (v + 1) % nodes : u;
+      g->weight[e] = 1 + next_random(&r) % max_weight;
+    }
+  }
+  g->first[nodes] = nodes * DEGREE;
+}
+
+// dijkstra(g, pq, dist) stores the distance of every node of g from node
+//   0 in dist, using pq (which must be empty), and produces the number
+//   of items removed from pq
+// effects: modifies pq and dist
+static long dijkstra(const struct graph *g, struct priqueue *pq, int *dist) {
+  for (int v = 0; v < g->nodes; v++) {
+    dist[v] = INT_MAX;
+  }
+  dist[0] = 0;
+  priqueue_add(pq, 0, 0);
+  long removes = 0;
+  while (priqueue_length(pq) > 0) {
+    int d = -priqueue_front_priority(pq);
+    int v = priqueue_remove(pq);
+    removes++;
+    if (d > dist[v]) continue;
+    for (int e = g->first[v]; e < g->first[v + 1]; e++) {
+      int u = g->to[e];
+      int du = d + g->weight[e];
+      if (du < dist[u]) {
+        dist[u] = du;
+        priqueue_add(pq, u, -du);
+      }
+    }
+  }
+  return removes;
+}
+
+int main(int argc, char **argv) {
+  int nodes = argc > 1 ? atoi(argv[1]) : 1000000;
+  int *dist = malloc(sizeof(int) * nodes);
+  int *expected = malloc(sizeof(int) * nodes);
+  static const int weights[] = {10, 1000, 100000};
+  printf("%-10s %-9s %10s %10s\n", "weights", "queue", "ms", "Mremoves/s");
+  for (int w = 0; w < 3; w++) {
+    struct graph g;
+    make_graph(&g, nodes, weights[w]);
+    for (int monotone = 1; monotone >= 0; monotone--) {
+      double best = 0;
+      long removes = 0;
+      for (int run = 0; run < RUNS; run++) {
+        struct priqueue *pq = monotone ? priqueue_create_monotone()
+                                       : priqueue_create();
+        double start = now();
+        removes = dijkstra(&g, pq, dist);
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+        priqueue_destroy(pq);
+      }
+      if (monotone) {
+        memcpy(expected, dist, sizeof(int) * nodes);
+      } else {
+        assert(memcmp(expected, dist, sizeof(int) * nodes) == 0);
+      }
+      printf("1..%-7d %-9s %10.1f %10.2f\n", weights[w],
+             monotone ? "radix" : "binary", best * 1e3, removes / best / 1e6);
+    }
+    free(g.first);
+    free(g.to);
+    free(g.weight);
+  }
+  free(expected);
+  free(dist);
+}
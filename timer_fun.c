@@ -0,0 +1,363 @@
+#include <stdbool.h>
+#timer.h
+// A timerwheel keeps timers (an item with a deadline) and fires them in
+// batches once their deadline has passed. Time is counted in ticks read
+// from a clock function supplied by the caller, so tests can drive it
+// by hand.
+//
+// Time is split into blocks of 2^24 ticks. Timers due in the current
+// block sit in a hierarchical timing wheel (4 levels of 64 slots), where
+// arming and cancelling are O(1). Timers due in a later block wait in a
+// priqueue until their block starts. Timers whose deadline has been
+// reached wait in a list sorted by deadline until they fire.
+
+struct timerwheel;
+
+// NOTES: All of the following functions REQUIRE:
+//        pointers to a timerwheel (e.g., tw) are valid (not NULL)
+//        deadlines are between 0 and 2^55 ticks
+//
+//       For times, n is the number of armed timers
+
+// timerwheel_create(clock, ctx) returns a pointer to a new timerwheel
+//   with no timers that reads the current tick as clock(ctx)
+// requires: clock never goes backwards
+// effects: allocates memory (caller must call timerwheel_destroy)
+// time: O(1)
+struct timerwheel *timerwheel_create(long long (*clock)(void *ctx),
+                                     void *ctx);
+
+// timerwheel_destroy(tw) frees all dynamically allocated memory
+//   (pending timers are dropped without firing)
+// effects: the memory at tw is invalid (freed)
+// time: O(1)
+void timerwheel_destroy(struct timerwheel *tw);
+
+// timerwheel_length(tw) determines how many timers are armed in tw
+// time: O(1)
+int timerwheel_length(const struct timerwheel *tw);
+
+// timer_arm(tw, deadline, item) arms a timer that fires item at the
+//   first timerwheel_expire once the clock reaches deadline, and returns
+//   an id for it (>= 0), which stays valid until the timer fires or is
+//   cancelled and may then be reused
+// effects: modifies tw
+// time: O(1) amortized, O(logn) if deadline is in a later block, O(d)
+//   if deadline has already passed, where d is the number of reached
+//   timers with a later deadline that have not fired yet
+int timer_arm(struct timerwheel *tw, long long deadline, int item);
+
+// timer_cancel(tw, id) disarms the timer with the given id
+// requires: id is valid for tw
+// effects: modifies tw
+//          id is no longer valid
+// time: O(1), O(logn) if the deadline was in a later block
+void timer_cancel(struct timerwheel *tw, int id);
+
+// timerwheel_expire(tw, fire, ctx) reads the clock and calls
+//   fire(item, ctx) for the item of every timer whose deadline has been
+//   reached, in order of deadline, and returns how many fired
+// note: fire may arm and cancel timers of tw
+// effects: modifies tw, calls fire
+// time: O(b + k), where b is the number of wheel slots with timers that
+//   the clock passed since the last call (empty slots are skipped) and
+//   k is the number of timers fired
+int timerwheel_expire(struct timerwheel *tw,
+                      void (*fire)(int item, void *ctx), void *ctx);
+
+
+
+#include "timer.h"
+#include "priqueue.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#define SLOT_BITS 6
+#define SLOTS (1 << SLOT_BITS)
+#define LEVELS 4
+#define WHEEL_BITS (SLOT_BITS * LEVELS)
+
+// where a timer is: a list of the wheel (level * SLOTS + slot), the
+// list of timers that are already due, the far priqueue, or unused
+static const int DUE = LEVELS * SLOTS;
+static const int FAR = -1;
+static const int UNUSED = -2;
+
+// a timer is in a doubly linked list of the timers of one slot (or the
+// due list); next links unused timers together
+struct timer {
+  long long deadline;
+  int item;
+  int where;
+  int prev;
+  int next;
+  int handle;
+};
+
+// every timer with a deadline <= now has been moved to the due list,
+//   which is sorted by deadline (and then by when it was placed)
+// heads[k] is the first timer of list k (-1 if it is empty), and
+//   duetail is the last timer of the due list
+// bit s of occupied[level] is set if list level * SLOTS + s is not empty
+// far holds timer ids with priority -(deadline >> WHEEL_BITS)
+struct timerwheel {
+  long long (*clock)(void *ctx);
+  void *ctx;
+  long long now;
+  int len;
+  struct timer *timers;
+  int maxtimers;
+  int ntimers;
+  int freetimer;
+  int heads[LEVELS * SLOTS + 1];
+  int duetail;
+  unsigned long long occupied[LEVELS];
+  struct priqueue *far;
+};
+
+struct timerwheel *timerwheel_create(long long (*clock)(void *ctx),
+                                     void *ctx) {
+  struct timerwheel *new = malloc(sizeof(struct timerwheel));
+  new->clock = clock;
+  new->ctx = ctx;
+  new->now = clock(ctx);
+  new->len = 0;
+  new->maxtimers = 16;
+  new->timers = malloc(sizeof(struct timer) * new->maxtimers);
+  new->ntimers = 0;
+  new->freetimer = -1;
+  for (int k = 0; k <= DUE; k++) {
+    new->heads[k] = -1;
+  }
+  new->duetail = -1;
+  for (int level = 0; level < LEVELS; level++) {
+    new->occupied[level] = 0;
+  }
+  new->far = priqueue_create();
+  return new;
+}
+
+void timerwheel_destroy(struct timerwheel *tw) {
+  priqueue_destroy(tw->far);
+  free(tw->timers);
+  free(tw);
+}
+
+int timerwheel_length(const struct timerwheel *tw) {
+  return tw->len;
+}
+
+// list_push(tw,k,id) adds timer id to list k
+// effects: modifies tw
+// time: O(1)
+static void list_push(struct timerwheel *tw, int k, int id) {
+  struct timer *t = &tw->timers[id];
+  t->where = k;
+  t->prev = -1;
+  t->next = tw->heads[k];
+  if (t->next >= 0) tw->timers[t->next].prev = id;
+  tw->heads[k] = id;
+  if (k < DUE) tw->occupied[k / SLOTS] |= 1ULL << (k % SLOTS);
+}
+
+// list_unlink(tw,id) removes timer id from it's list
+// effects: modifies tw
+// time: O(1)
+static void list_unlink(struct timerwheel *tw, int id) {
+  struct timer *t = &tw->timers[id];
+  if (t->prev >= 0) {
+    tw->timers[t->prev].next = t->next;
+  } else {
+    tw->heads[t->where] = t->next;
+    if (t->next < 0 && t->where < DUE) {
+      tw->occupied[t->where / SLOTS] &= ~(1ULL << (t->where % SLOTS));
+    }
+  }
+  if (t->next >= 0) {
+    tw->timers[t->next].prev = t->prev;
+  } else if (t->where == DUE) {
+    tw->duetail = t->prev;
+  }
+}
+
+// due_insert(tw,id) adds timer id to the due list after every timer
+// with a deadline that is not later than it's own
+// effects: modifies tw
+// time: O(1), O(d) if d timers of the due list have a later deadline
+static void due_insert(struct timerwheel *tw, int id) {
+  struct timer *t = &tw->timers[id];
+  int prev = tw->duetail;
+  while (prev >= 0 && tw->timers[prev].deadline > t->deadline) {
+    prev = tw->timers[prev].prev;
+  }
+  t->where = DUE;
+  t->prev = prev;
+  if (prev >= 0) {
+    t->next = tw->timers[prev].next;
+    tw->timers[prev].next = id;
+  } else {
+    t->next = tw->heads[DUE];
+    tw->heads[DUE] = id;
+  }
+  if (t->next >= 0) {
+    tw->timers[t->next].prev = id;
+  } else {
+    tw->duetail = id;
+  }
+}
+
+// place(tw,id) stores timer id in the list for it's deadline: the level
+// is the highest group of SLOT_BITS bits in which the deadline differs
+// from now, so the timer is moved down a level (cascaded) exactly when
+// now catches up with that group
+// effects: modifies tw
+// time: O(1), O(logn) for a far timer, plus due_insert for a due one
+static void place(struct timerwheel *tw, int id) {
+  struct timer *t = &tw->timers[id];
+  if (t->deadline <= tw->now) {
+    due_insert(tw, id);
+    return;
+  }
+  long long diff = t->deadline ^ tw->now;
+  if (diff >> WHEEL_BITS) {
+    t->where = FAR;
+    t->handle = priqueue_add(tw->far, id,
+                             -(int)(t->deadline >> WHEEL_BITS));
+    return;
+  }
+  int level = 0;
+  while (diff >> (SLOT_BITS * (level + 1))) {
+    level++;
+  }
+  int slot = (t->deadline >> (SLOT_BITS * level)) & (SLOTS - 1);
+  list_push(tw, level * SLOTS + slot, id);
+}
+
+int timer_arm(struct timerwheel *tw, long long deadline, int item) {
+  assert(0 <= deadline && deadline < (1LL << 55));
+  int id = tw->freetimer;
+  if (id >= 0) {
+    tw->freetimer = tw->timers[id].next;
+  } else {
+    if (tw->ntimers == tw->maxtimers) {
+      tw->maxtimers *= 2;
+      tw->timers = realloc(tw->timers,
+                           sizeof(struct timer) * tw->maxtimers);
+    }
+    id = tw->ntimers++;
+  }
+  tw->timers[id].deadline = deadline;
+  tw->timers[id].item = item;
+  place(tw, id);
+  tw->len++;
+  return id;
+}
+
+// timer_free(tw,id) gives the id of a timer that is in no list back to
+// tw for reuse
+// effects: modifies tw
+// time: O(1)
+static void timer_free(struct timerwheel *tw, int id) {
+  tw->timers[id].where = UNUSED;
+  tw->timers[id].next = tw->freetimer;
+  tw->freetimer = id;
+  tw->len--;
+}
+
+void timer_cancel(struct timerwheel *tw, int id) {
+  struct timer *t = &tw->timers[id];
+  assert(t->where != UNUSED);
+  if (t->where == FAR) {
+    priqueue_delete(tw->far, t->handle);
+  } else {
+    list_unlink(tw, id);
+  }
+  timer_free(tw, id);
+}
+
+// cascade(tw,k) places again every timer of list k, after now has moved
+// into the range that list k covers
+// effects: modifies tw
+// time: O(m), where m is the number of timers in list k
+static void cascade(struct timerwheel *tw, int k) {
+  int id = tw->heads[k];
+  tw->heads[k] = -1;
+  tw->occupied[k / SLOTS] &= ~(1ULL << (k % SLOTS));
+  while (id >= 0) {
+    int next = tw->timers[id].next;
+    place(tw, id);
+    id = next;
+  }
+}
+
+// advance(tw,now) moves tw to the tick now, moving the timers that are
+// due at now to the due list
+// requires: no list is cascaded or due at a tick between tw->now and now
+// effects: modifies tw
+// time: O(1) amortized
+static void advance(struct timerwheel *tw, long long now) {
+  tw->now = now;
+  if ((now & ((1LL << WHEEL_BITS) - 1)) == 0) {
+    int block = -(int)(now >> WHEEL_BITS);
+    while (priqueue_length(tw->far) > 0 &&
+           priqueue_front_priority(tw->far) >= block) {
+      place(tw, priqueue_remove(tw->far));
+    }
+  }
+  for (int level = LEVELS - 1; level > 0; level--) {
+    if ((now & ((1LL << (SLOT_BITS * level)) - 1)) == 0) {
+      int slot = (now >> (SLOT_BITS * level)) & (SLOTS - 1);
+      cascade(tw, level * SLOTS + slot);
+    }
+  }
+  cascade(tw, now & (SLOTS - 1));
+}
+
+// next_event(tw) produces the first tick after now at which a list of
+// the wheel is cascaded or due, or the next block of far timers starts
+// (LLONG_MAX if tw has no such timers)
+// time: O(1)
+static long long next_event(const struct timerwheel *tw) {
+  long long next = LLONG_MAX;
+  if (priqueue_length(tw->far) > 0) {
+    next = -(long long)priqueue_front_priority(tw->far) << WHEEL_BITS;
+  }
+  for (int level = LEVELS - 1; level >= 0; level--) {
+    int shift = SLOT_BITS * level;
+    int slot = (tw->now >> shift) & (SLOTS - 1);
+    unsigned long long later = slot == SLOTS - 1 ? 0 :
+                               tw->occupied[level] & (~0ULL << (slot + 1));
+    if (later) {
+      long long base = tw->now & ~((1LL << (shift + SLOT_BITS)) - 1);
+      next = base | (long long)__builtin_ctzll(later) << shift;
+    }
+  }
+  return next;
+}
+
+int timerwheel_expire(struct timerwheel *tw,
+                      void (*fire)(int item, void *ctx), void *ctx) {
+  long long target = tw->clock(tw->ctx);
+  int fired = 0;
+  while (1) {
+    int id = tw->heads[DUE];
+    if (id >= 0) {
+      int item = tw->timers[id].item;
+      list_unlink(tw, id);
+      timer_free(tw, id);
+      fire(item, ctx);
+      fired++;
+    } else if (tw->now < target) {
+      long long next = next_event(tw);
+      if (next > target) {
+        tw->now = target;
+      } else {
+        advance(tw, next);
+      }
+    } else {
+      break;
+    }
+  }
+  return fired;
+}
@@ -0,0 +1,156 @@
+// Deterministic tests for the timer wheel: a fake clock is moved by
+// hand across the boundaries of every wheel level and of the far
+// blocks, and each timerwheel_expire must fire exactly the timers whose
+// deadline has been reached, in order of deadline.
+//
+// timer.h and priqueue.h are the header parts at the top of timer_fun.c
+// and priqueue_fun.c. Build with e.g.
+//   gcc -std=c99 -O1 -g -fsanitize=address,undefined timer_fun.c
+//       priqueue_fun.c timer_test.c -o timer_test
+// It prints "OK", or stops at a failed assert.
+
+#include "timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define MAX_TIMERS 4096
+
+static long long clock_now;
+
+// fake_clock(ctx) produces the tick the test has set
+static long long fake_clock(void *ctx) {
+  (void)ctx;
+  return clock_now;
+}
+
+// every item is an index into deadline and armed; fired records the
+// items in the order they fired
+static long long deadline[MAX_TIMERS];
+static bool armed[MAX_TIMERS];
+static int ids[MAX_TIMERS];
+static int fired[MAX_TIMERS];
+static int nfired;
+
+// record(item, ctx) checks that item is due and fires no earlier than
+//   the timer fired before it, and records it
+static void record(int item, void *ctx) {
+  (void)ctx;
+  assert(armed[item]);
+  assert(deadline[item] <= clock_now);
+  if (nfired > 0) assert(deadline[fired[nfired - 1]] <= deadline[item]);
+  armed[item] = false;
+  fired[nfired++] = item;
+}
+
+// expire_to(tw, tick) moves the clock to tick, expires tw and checks that
+//   every timer with a deadline <= tick fired and no other did
+static void expire_to(struct timerwheel *tw, long long tick) {
+  clock_now = tick;
+  nfired = 0;
+  int n = timerwheel_expire(tw, record, NULL);
+  assert(n == nfired);
+  int left = 0;
+  for (int item = 0; item < MAX_TIMERS; item++) {
+    if (armed[item]) {
+      assert(deadline[item] > tick);
+      left++;
+    }
+  }
+  assert(timerwheel_length(tw) == left);
+}
+
+// arm(tw, item, d) arms a timer for item with deadline d
+static void arm(struct timerwheel *tw, int item, long long d) {
+  deadline[item] = d;
+  armed[item] = true;
+  ids[item] = timer_arm(tw, d, item);
+}
+
+// test_past_deadlines() arms timers whose deadlines have already passed,
+//   out of order, and checks they still fire in order of deadline
+static void test_past_deadlines(void) {
+  clock_now = 200;
+  struct timerwheel *tw = timerwheel_create(fake_clock, NULL);
+  arm(tw, 0, 70);
+  arm(tw, 1, 50);
+  arm(tw, 2, 200);
+  arm(tw, 3, 60);
+  arm(tw, 4, 50);
+  expire_to(tw, 200);
+  assert(nfired == 5);
+  assert(fired[0] == 1 && fired[1] == 4 && fired[2] == 3);
+  assert(fired[3] == 0 && fired[4] == 2);
+  timerwheel_destroy(tw);
+}
+
+// test_boundaries() arms timers just before, at and after the first
+//   ticks of every wheel level and far block, in a scrambled order, and
+//   moves the clock across each of those ticks in steps of several sizes
+static void test_boundaries(void) {
+  static const long long edges[] = {
+    1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145,
+    16777215, 16777216, 16777217, 33554432, 1LL << 40,
+  };
+  static const long long steps[] = {1, 7, 64, 1000, 100000, 1LL << 20};
+  int nedges = sizeof(edges) / sizeof(edges[0]);
+  int nsteps = sizeof(steps) / sizeof(steps[0]);
+  for (int s = 0; s < nsteps; s++) {
+    clock_now = 0;
+    struct timerwheel *tw = timerwheel_create(fake_clock, NULL);
+    int items = 0;
+    for (int k = 0; k < nedges * 5; k++) {
+      long long d = edges[k * 7 % nedges] + k % 5 - 2;
+      arm(tw, items++, d < 0 ? 0 : d);
+    }
+    long long tick = 0;
+    for (int e = 0; e < nedges; e++) {
+      long long from = edges[e] - 3 * steps[s];
+      if (from > tick) {
+        tick = from;
+        expire_to(tw, tick);
+      }
+      for (int k = 0; k < 6; k++) {
+        tick += steps[s];
+        // timers armed while the clock runs (the second is already due
+        // when the step is small)
+        arm(tw, items++, tick + steps[s] * 3 / 2 + 1);
+        arm(tw, items++, tick > 5 ? tick - 5 : 0);
+        expire_to(tw, tick);
+      }
+    }
+    expire_to(tw, 1LL << 42);
+    assert(timerwheel_length(tw) == 0);
+    timerwheel_destroy(tw);
+  }
+}
+
+// test_cancel() cancels every third timer of a set spread over all the
+//   levels, and checks the rest fire in order and the cancelled never do
+static void test_cancel(void) {
+  clock_now = 1000;
+  struct timerwheel *tw = timerwheel_create(fake_clock, NULL);
+  unsigned r = 1;
+  for (int item = 0; item < 3000; item++) {
+    r = r * 1103515245 + 12345;
+    arm(tw, item, 1000 + (r >> 8) % (1 << (item % 27)) + 1);
+  }
+  for (int item = 0; item < 3000; item += 3) {
+    timer_cancel(tw, ids[item]);
+    armed[item] = false;
+  }
+  expire_to(tw, 1000);
+  assert(nfired == 0);
+  for (long long tick = 1000; timerwheel_length(tw) > 0; tick *= 3) {
+    expire_to(tw, tick);
+  }
+  timerwheel_destroy(tw);
+}
+
+int main(void) {
+  test_past_deadlines();
+  test_boundaries();
+  test_cancel();
+  puts("OK");
+}